@@ -2,8 +2,45 @@ TARGET = qbsdfb
 
 QT += core-private gui-private platformsupport-private
 
-SOURCES = main.cpp qbsdfbintegration.cpp qbsdfbscreen.cpp
-HEADERS = qbsdfbintegration.h qbsdfbscreen.h
+SOURCES = \
+    main.cpp \
+    qbsdfbintegration.cpp \
+    qbsdfbscreen.cpp \
+    qbsdfbdevice.cpp \
+    qbsdfbblitter.cpp \
+    qbsdfbbackingstore.cpp \
+    qbsdfbpresenter.cpp \
+    qbsdfbdamage.cpp \
+    qbsdfbtilecache.cpp \
+    qbsdfbframestats.cpp \
+    qbsdfbtracer.cpp \
+    qbsdfbmirror.cpp \
+    qbsdfbcursor.cpp \
+    qbsdfbstartup.cpp \
+    qbsdfbfontdatabase.cpp \
+    qbsdfbeventdispatcher.cpp \
+    qbsdfbinput.cpp \
+    qbsdfbarena.cpp
+
+HEADERS = \
+    qbsdfbintegration.h \
+    qbsdfbscreen.h \
+    qbsdfbdevice.h \
+    qbsdfbblitter.h \
+    qbsdfbbackingstore.h \
+    qbsdfbpresenter.h \
+    qbsdfbdamage.h \
+    qbsdfbtilecache.h \
+    qbsdfbframestats.h \
+    qbsdfbtracer.h \
+    qbsdfbmirror.h \
+    qbsdfbmirrorprotocol.h \
+    qbsdfbcursor.h \
+    qbsdfbstartup.h \
+    qbsdfbfontdatabase.h \
+    qbsdfbeventdispatcher.h \
+    qbsdfbinput.h \
+    qbsdfbarena.h
 
 CONFIG += qpa/genericunixfontdatabase
 
@@ -0,0 +1,147 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbarena.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+
+QT_BEGIN_NAMESPACE
+
+enum {
+    HugePageSize = 2 * 1024 * 1024
+};
+
+QBsdFbArena::QBsdFbArena(bool hugePages, bool prefault, bool columnAccess)
+    : m_hugePages(hugePages),
+      m_prefault(prefault),
+      m_columnAccess(columnAccess)
+{
+}
+
+QBsdFbArena::~QBsdFbArena()
+{
+    for (const Block &block : qAsConst(m_blocks))
+        munmap(block.data, block.size);
+}
+
+// Rows start on a cache line. With column access a row that is a multiple
+// of 1 KiB gets one more line: its rows would otherwise map to the same few
+// cache sets, and walking a rect column by column, as the rotating blitter
+// does, would keep evicting its own lines. Row by row that aliasing does
+// not matter, while the extra line would split every full-width rect into
+// one span per row, so common widths such as 1280 and 1920 at 32 bpp stay
+// unpadded.
+int QBsdFbArena::paddedBytesPerLine(int width, QImage::Format format, bool columnAccess)
+{
+    int bytesPerLine = (width * QImage::toPixelFormat(format).bitsPerPixel() + 7) / 8;
+    bytesPerLine = (bytesPerLine + CacheLineSize - 1) & ~(CacheLineSize - 1);
+    if (columnAccess && bytesPerLine % 1024 == 0)
+        bytesPerLine += CacheLineSize;
+    return bytesPerLine;
+}
+
+QImage QBsdFbArena::allocate(const QSize &size, QImage::Format format)
+{
+    if (size.isEmpty())
+        return QImage();
+
+    const int bytesPerLine = paddedBytesPerLine(size.width(), format, m_columnAccess);
+    size_t mapped = size_t(bytesPerLine) * size.height();
+    uchar *data = static_cast<uchar *>(map(&mapped));
+    if (!data)
+        return QImage();
+
+    if (m_prefault) {
+        // Anonymous memory reads as zero without being allocated, only a
+        // write faults the page in for good
+        const size_t pageSize = getpagesize();
+        volatile uchar *touch = data;
+        for (size_t offset = 0; offset < mapped; offset += pageSize)
+            touch[offset] = 0;
+    }
+
+    m_blocks.append({ data, mapped });
+    m_size += mapped;
+    return QImage(data, size.width(), size.height(), bytesPerLine, format);
+}
+
+// size is rounded up to what was actually mapped
+void *QBsdFbArena::map(size_t *size)
+{
+    const size_t pagemask = getpagesize() - 1;
+    void *data = MAP_FAILED;
+
+    if (m_hugePages) {
+        const size_t hugeSize = (*size + HugePageSize - 1) & ~size_t(HugePageSize - 1);
+#if defined(MAP_HUGETLB)
+        // Only succeeds with huge pages reserved by the administrator
+        data = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED) {
+            m_hugePageMode = "hugetlb";
+            *size = hugeSize;
+            return data;
+        }
+#endif
+#if defined(MAP_ALIGNED_SUPER)
+        // Fully populated, aligned mappings are promoted to superpages
+        data = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_ALIGNED_SUPER, -1, 0);
+        if (data != MAP_FAILED) {
+            m_hugePageMode = "superpages";
+            *size = hugeSize;
+            return data;
+        }
+#endif
+#if defined(MADV_HUGEPAGE)
+        data = mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (data != MAP_FAILED) {
+            if (madvise(data, hugeSize, MADV_HUGEPAGE) == 0)
+                m_hugePageMode = "transparent";
+            *size = hugeSize;
+            return data;
+        }
+#endif
+    }
+
+    *size = (*size + pagemask) & ~pagemask;
+    data = mmap(nullptr, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (data == MAP_FAILED) {
+        qErrnoWarning(errno, "bsdfb: Failed to map %zu bytes for the shadow buffer", *size);
+        return nullptr;
+    }
+    return data;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,92 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBARENA_H
+#define QBSDFBARENA_H
+
+#include <QtCore/QVector>
+#include <QtGui/QImage>
+
+QT_BEGIN_NAMESPACE
+
+// Owns the images the screen streams through every frame: the composed
+// screen and the presenter's buffers. Each image gets its own anonymous
+// mapping, so it starts on a page boundary, and its rows are padded to
+// whole cache lines. Rows that are already whole cache lines are only
+// padded further for column access, since unpadded rows let blits convert
+// full-width rects as one span. Memory is optionally backed by huge pages and faulted
+// in up front, so the first frames do not pay for it. Images handed out
+// stay valid until the arena is destroyed.
+class QBsdFbArena
+{
+public:
+    enum {
+        CacheLineSize = 64
+    };
+
+    // columnAccess: images are read column by column, as when rotating
+    QBsdFbArena(bool hugePages, bool prefault, bool columnAccess = false);
+    ~QBsdFbArena();
+
+    // A null image if the memory could not be mapped
+    QImage allocate(const QSize &size, QImage::Format format);
+
+    static int paddedBytesPerLine(int width, QImage::Format format, bool columnAccess);
+
+    // How huge pages were requested from the kernel, "off" if not at all
+    const char *hugePageMode() const { return m_hugePageMode; }
+    bool prefaults() const { return m_prefault; }
+    size_t size() const { return m_size; }
+
+private:
+    void *map(size_t *size);
+
+    struct Block {
+        void *data;
+        size_t size;
+    };
+
+    QVector<Block> m_blocks;
+    size_t m_size = 0;
+    bool m_hugePages;
+    bool m_prefault;
+    bool m_columnAccess;
+    const char *m_hugePageMode = "off";
+
+    Q_DISABLE_COPY(QBsdFbArena)
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBARENA_H
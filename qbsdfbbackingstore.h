@@ -0,0 +1,65 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBBACKINGSTORE_H
+#define QBSDFBBACKINGSTORE_H
+
+#include <QtPlatformSupport/private/qfbbackingstore_p.h>
+
+QT_BEGIN_NAMESPACE
+
+class QBsdFbScreen;
+
+// A backing store that the screen can present without composition while
+// its window is the only one on screen. Attached with framebuffer memory,
+// the window paints straight into the mapped framebuffer.
+class QBsdFbBackingStore : public QFbBackingStore
+{
+public:
+    explicit QBsdFbBackingStore(QWindow *window);
+    ~QBsdFbBackingStore() override;
+
+    void resize(const QSize &size, const QRegion &region) override;
+
+    void attachToScreen(QBsdFbScreen *screen, uchar *framebuffer = nullptr, int bytesPerLine = 0);
+    void detachFromScreen();
+
+private:
+    QBsdFbScreen *m_scanoutScreen = nullptr;
+    bool m_direct = false;
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBBACKINGSTORE_H
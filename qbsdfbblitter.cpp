@@ -0,0 +1,809 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbblitter.h"
+
+#include <private/qsimd_p.h>
+
+#include <limits.h>
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+static inline quint16 convertRgb32To16(quint32 p)
+{
+    return ((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) | ((p >> 3) & 0x001f);
+}
+
+template <int BytesPerPixel>
+static void copyPixels(uchar *dst, const uchar *src, int count)
+{
+    memcpy(dst, src, size_t(count) * BytesPerPixel);
+}
+
+static void convertRgb32ToRgb16(uchar *dst, const uchar *src, int count)
+{
+    const quint32 *s = reinterpret_cast<const quint32 *>(src);
+    quint16 *d = reinterpret_cast<quint16 *>(dst);
+    for (int i = 0; i < count; ++i)
+        d[i] = convertRgb32To16(s[i]);
+}
+
+static void convertRgb32ToRgb888(uchar *dst, const uchar *src, int count)
+{
+    const quint32 *s = reinterpret_cast<const quint32 *>(src);
+    for (int i = 0; i < count; ++i) {
+        const quint32 p = s[i];
+        *dst++ = p >> 16;
+        *dst++ = p >> 8;
+        *dst++ = p;
+    }
+}
+
+#if QT_COMPILER_SUPPORTS_HERE(SSE2)
+QT_FUNCTION_TARGET(SSE2)
+static inline __m128i convertRgb32To16_sse2(__m128i p)
+{
+    const __m128i r = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xf800));
+    const __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07e0));
+    const __m128i b = _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001f));
+    const __m128i c = _mm_or_si128(_mm_or_si128(r, g), b);
+    // Sign-extend so the saturating pack keeps the low 16 bits unchanged
+    return _mm_srai_epi32(_mm_slli_epi32(c, 16), 16);
+}
+
+QT_FUNCTION_TARGET(SSE2)
+static void convertRgb32ToRgb16_sse2(uchar *dst, const uchar *src, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4 + 16));
+        const __m128i c = _mm_packs_epi32(convertRgb32To16_sse2(a), convertRgb32To16_sse2(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 2), c);
+    }
+    convertRgb32ToRgb16(dst + i * 2, src + i * 4, count - i);
+}
+#endif
+
+#if QT_COMPILER_SUPPORTS_HERE(AVX2)
+QT_FUNCTION_TARGET(AVX2)
+static inline __m256i convertRgb32To16_avx2(__m256i p)
+{
+    const __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 8), _mm256_set1_epi32(0xf800));
+    const __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 5), _mm256_set1_epi32(0x07e0));
+    const __m256i b = _mm256_and_si256(_mm256_srli_epi32(p, 3), _mm256_set1_epi32(0x001f));
+    const __m256i c = _mm256_or_si256(_mm256_or_si256(r, g), b);
+    return _mm256_srai_epi32(_mm256_slli_epi32(c, 16), 16);
+}
+
+QT_FUNCTION_TARGET(AVX2)
+static void convertRgb32ToRgb16_avx2(uchar *dst, const uchar *src, int count)
+{
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4 + 32));
+        // packs works per 128-bit lane, restore the pixel order afterwards
+        __m256i c = _mm256_packs_epi32(convertRgb32To16_avx2(a), convertRgb32To16_avx2(b));
+        c = _mm256_permute4x64_epi64(c, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 2), c);
+    }
+    convertRgb32ToRgb16(dst + i * 2, src + i * 4, count - i);
+}
+#endif
+
+#if QT_COMPILER_SUPPORTS_HERE(SSE2)
+// Stores bypass the cache from the first 16 byte boundary on
+QT_FUNCTION_TARGET(SSE2)
+static void streamBytes_sse2(uchar *dst, const uchar *src, size_t bytes)
+{
+    const size_t head = qMin(bytes, size_t(-quintptr(dst) & 15));
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    bytes -= head;
+
+    for (; bytes >= 64; bytes -= 64, dst += 64, src += 64) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst), a);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 16), b);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 32), c);
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst + 48), d);
+    }
+    for (; bytes >= 16; bytes -= 16, dst += 16, src += 16)
+        _mm_stream_si128(reinterpret_cast<__m128i *>(dst), _mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+    memcpy(dst, src, bytes);
+
+    // Drain the write-combining buffers before the frame counts as presented
+    _mm_sfence();
+}
+#endif
+
+#if defined(__ARM_NEON__)
+static void convertRgb32ToRgb16_neon(uchar *dst, const uchar *src, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // Little endian RGB32 is stored as B, G, R, X
+        const uint8x8x4_t p = vld4_u8(src + i * 4);
+        uint16x8_t c = vshll_n_u8(p.val[2], 8);
+        c = vsriq_n_u16(c, vshll_n_u8(p.val[1], 8), 5);
+        c = vsriq_n_u16(c, vshll_n_u8(p.val[0], 8), 11);
+        vst1q_u16(reinterpret_cast<quint16 *>(dst + i * 2), c);
+    }
+    convertRgb32ToRgb16(dst + i * 2, src + i * 4, count - i);
+}
+
+static void convertRgb32ToRgb888_neon(uchar *dst, const uchar *src, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint8x8x4_t p = vld4_u8(src + i * 4);
+        uint8x8x3_t c;
+        c.val[0] = p.val[2];
+        c.val[1] = p.val[1];
+        c.val[2] = p.val[0];
+        vst3_u8(dst + i * 3, c);
+    }
+    convertRgb32ToRgb888(dst + i * 3, src + i * 4, count - i);
+}
+#endif
+
+enum {
+    // Shorter spans are cheaper to write through the cache than to fence
+    StreamBytes = 2048,
+    // Pixels converted at a time before streaming them out, the buffer
+    // stays in L1
+    StreamChunk = 1024,
+    // 32 rows of 32 pixels touch at most 32 cache lines of the source
+    // and the destination each
+    RotateTile = 32
+};
+
+template <int BytesPerPixel>
+struct CopyPixel
+{
+    enum { TargetBytes = BytesPerPixel };
+    static inline void convert(uchar *dst, const uchar *src) { memcpy(dst, src, BytesPerPixel); }
+};
+
+struct Rgb32ToRgb16Pixel
+{
+    enum { TargetBytes = 2 };
+    static inline void convert(uchar *dst, const uchar *src)
+    {
+        *reinterpret_cast<quint16 *>(dst) = convertRgb32To16(*reinterpret_cast<const quint32 *>(src));
+    }
+};
+
+struct Rgb32ToRgb888Pixel
+{
+    enum { TargetBytes = 3 };
+    static inline void convert(uchar *dst, const uchar *src)
+    {
+        const quint32 p = *reinterpret_cast<const quint32 *>(src);
+        dst[0] = p >> 16;
+        dst[1] = p >> 8;
+        dst[2] = p;
+    }
+};
+
+// Narrows an 8 bit channel, or widens it by repeating its top bits so that
+// full intensity stays full intensity
+template <int Bits>
+static inline quint32 scaleChannel(quint32 c)
+{
+    return Bits <= 8 ? c >> (8 - qMin(Bits, 8))
+                     : (c << (qMax(Bits, 8) - 8)) | (c >> (16 - qMax(Bits, 8)));
+}
+
+template <int Bytes>
+static inline void storePixel(uchar *dst, quint32 v)
+{
+    switch (Bytes) {
+    case 1:
+        *dst = v;
+        break;
+    case 2:
+        *reinterpret_cast<quint16 *>(dst) = v;
+        break;
+    case 3:
+        dst[0] = v;
+        dst[1] = v >> 8;
+        dst[2] = v >> 16;
+        break;
+    case 4:
+        *reinterpret_cast<quint32 *>(dst) = v;
+        break;
+    }
+}
+
+// RGB32 to a framebuffer pixel of Bytes bytes with each channel given as
+// the shift and width of its field in the pixel value
+template <int Bytes, int RShift, int RBits, int GShift, int GBits, int BShift, int BBits>
+struct Rgb32ToPackedPixel
+{
+    enum { TargetBytes = Bytes };
+    static inline void convert(uchar *dst, const uchar *src)
+    {
+        const quint32 p = *reinterpret_cast<const quint32 *>(src);
+        storePixel<Bytes>(dst, (scaleChannel<RBits>((p >> 16) & 0xff) << RShift)
+                             | (scaleChannel<GBits>((p >> 8) & 0xff) << GShift)
+                             | (scaleChannel<BBits>(p & 0xff) << BShift));
+    }
+};
+
+typedef Rgb32ToPackedPixel<1, 5, 3, 2, 3, 0, 2> Rgb32ToRgb332Pixel;
+typedef Rgb32ToPackedPixel<2, 10, 5, 5, 5, 0, 5> Rgb32ToXrgb1555Pixel;
+typedef Rgb32ToPackedPixel<2, 0, 5, 5, 5, 10, 5> Rgb32ToXbgr1555Pixel;
+typedef Rgb32ToPackedPixel<2, 0, 5, 5, 6, 11, 5> Rgb32ToBgr565Pixel;
+typedef Rgb32ToPackedPixel<3, 16, 8, 8, 8, 0, 8> Rgb32ToBgrPixel;
+typedef Rgb32ToPackedPixel<4, 0, 8, 8, 8, 16, 8> Rgb32ToXbgr8888Pixel;
+typedef Rgb32ToPackedPixel<4, 20, 10, 10, 10, 0, 10> Rgb32ToXrgb2101010Pixel;
+typedef Rgb32ToPackedPixel<4, 0, 10, 10, 10, 20, 10> Rgb32ToXbgr2101010Pixel;
+
+// The console has a single palette, so all screens share one table, which
+// maps RGB555 to the closest palette entry
+static uchar paletteLookup[32768];
+
+struct Rgb32ToPalettePixel
+{
+    enum { TargetBytes = 1 };
+    static inline void convert(uchar *dst, const uchar *src)
+    {
+        const quint32 p = *reinterpret_cast<const quint32 *>(src);
+        *dst = paletteLookup[((p >> 9) & 0x7c00) | ((p >> 6) & 0x03e0) | ((p >> 3) & 0x001f)];
+    }
+};
+
+template <typename Pixel>
+static void convertPixels(uchar *dst, const uchar *src, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        Pixel::convert(dst, src);
+        dst += Pixel::TargetBytes;
+        src += 4;
+    }
+}
+
+#if QT_COMPILER_SUPPORTS_HERE(SSE2)
+// Swaps red and blue, the X byte is left as it is
+QT_FUNCTION_TARGET(SSE2)
+static void convertRgb32ToXbgr8888_sse2(uchar *dst, const uchar *src, int count)
+{
+    const __m128i ga = _mm_set1_epi32(0xff00ff00);
+    const __m128i rb = _mm_set1_epi32(0x000000ff);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+        const __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), rb);
+        const __m128i b = _mm_slli_epi32(_mm_and_si128(p, rb), 16);
+        const __m128i c = _mm_or_si128(_mm_and_si128(p, ga), _mm_or_si128(r, b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), c);
+    }
+    convertPixels<Rgb32ToXbgr8888Pixel>(dst + i * 4, src + i * 4, count - i);
+}
+#endif
+
+// Writes width x height target pixels row by row. The source pixel for
+// target (x, y) is at src + x * stepX + y * stepY.
+template <typename Pixel>
+static void rotatePixels(uchar *dst, int dbpl, const uchar *src, qptrdiff stepX, qptrdiff stepY,
+                         int width, int height)
+{
+    for (int ty = 0; ty < height; ty += RotateTile) {
+        const int tileBottom = qMin<int>(ty + RotateTile, height);
+        for (int tx = 0; tx < width; tx += RotateTile) {
+            const int tileWidth = qMin<int>(RotateTile, width - tx);
+            for (int y = ty; y < tileBottom; ++y) {
+                uchar *d = dst + y * dbpl + tx * Pixel::TargetBytes;
+                const uchar *s = src + y * stepY + tx * stepX;
+                for (int x = 0; x < tileWidth; ++x) {
+                    Pixel::convert(d, s);
+                    d += Pixel::TargetBytes;
+                    s += stepX;
+                }
+            }
+        }
+    }
+}
+
+// Nearest neighbour upscaling of a converted row: every pixel is repeated
+// factor times
+template <int BytesPerPixel>
+static void expandPixels(uchar *dst, const uchar *src, int count, int factor)
+{
+    for (int i = 0; i < count; ++i) {
+        for (int n = 0; n < factor; ++n) {
+            memcpy(dst, src, BytesPerPixel);
+            dst += BytesPerPixel;
+        }
+        src += BytesPerPixel;
+    }
+}
+
+#if QT_COMPILER_SUPPORTS_HERE(SSE2)
+// Doubling, the common case, by interleaving pixels with themselves
+QT_FUNCTION_TARGET(SSE2)
+static void expandPixels32_sse2(uchar *dst, const uchar *src, int count, int factor)
+{
+    if (factor != 2) {
+        expandPixels<4>(dst, src, count, factor);
+        return;
+    }
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 8), _mm_unpacklo_epi32(p, p));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 8 + 16), _mm_unpackhi_epi32(p, p));
+    }
+    expandPixels<4>(dst + i * 8, src + i * 4, count - i, 2);
+}
+
+QT_FUNCTION_TARGET(SSE2)
+static void expandPixels16_sse2(uchar *dst, const uchar *src, int count, int factor)
+{
+    if (factor != 2) {
+        expandPixels<2>(dst, src, count, factor);
+        return;
+    }
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_unpacklo_epi16(p, p));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4 + 16), _mm_unpackhi_epi16(p, p));
+    }
+    expandPixels<2>(dst + i * 4, src + i * 2, count - i, 2);
+}
+#endif
+
+#if defined(__ARM_NEON__)
+static void expandPixels32_neon(uchar *dst, const uchar *src, int count, int factor)
+{
+    if (factor != 2) {
+        expandPixels<4>(dst, src, count, factor);
+        return;
+    }
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint32x4_t p = vld1q_u32(reinterpret_cast<const quint32 *>(src + i * 4));
+        vst2q_u32(reinterpret_cast<quint32 *>(dst + i * 8), uint32x4x2_t{ { p, p } });
+    }
+    expandPixels<4>(dst + i * 8, src + i * 4, count - i, 2);
+}
+
+static void expandPixels16_neon(uchar *dst, const uchar *src, int count, int factor)
+{
+    if (factor != 2) {
+        expandPixels<2>(dst, src, count, factor);
+        return;
+    }
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint16x8_t p = vld1q_u16(reinterpret_cast<const quint16 *>(src + i * 2));
+        vst2q_u16(reinterpret_cast<quint16 *>(dst + i * 4), uint16x8x2_t{ { p, p } });
+    }
+    expandPixels<2>(dst + i * 4, src + i * 2, count - i, 2);
+}
+#endif
+
+static int bytesPerPixel(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGB32:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGB30:
+    case QImage::Format_BGR30:
+        return 4;
+    case QImage::Format_RGB888:
+        return 3;
+    case QImage::Format_RGB16:
+    case QImage::Format_RGB555:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+bool QBsdFbBlitter::setFormats(QImage::Format source, QBsdFbDevice::PixelLayout target)
+{
+    m_convert = nullptr;
+    m_rotate = nullptr;
+    m_copy = false;
+    m_name = "none";
+    m_sourceBytesPerPixel = bytesPerPixel(source);
+    m_targetBytesPerPixel = QBsdFbDevice::bytesPerPixel(target);
+
+    if (!m_sourceBytesPerPixel || !m_targetBytesPerPixel)
+        return false;
+
+    if (source == QBsdFbDevice::imageFormat(target)) {
+        switch (m_targetBytesPerPixel) {
+        case 4:
+            m_convert = copyPixels<4>;
+            m_rotate = rotatePixels<CopyPixel<4> >;
+            break;
+        case 3:
+            m_convert = copyPixels<3>;
+            m_rotate = rotatePixels<CopyPixel<3> >;
+            break;
+        case 2:
+            m_convert = copyPixels<2>;
+            m_rotate = rotatePixels<CopyPixel<2> >;
+            break;
+        case 1:
+            m_convert = copyPixels<1>;
+            m_rotate = rotatePixels<CopyPixel<1> >;
+            break;
+        }
+        m_copy = true;
+        m_name = "copy";
+        return true;
+    }
+
+    if (source != QImage::Format_RGB32)
+        return false;
+
+    switch (target) {
+    case QBsdFbDevice::C8:
+        m_convert = convertPixels<Rgb32ToRgb332Pixel>;
+        m_rotate = rotatePixels<Rgb32ToRgb332Pixel>;
+        m_name = "rgb32-rgb332";
+        break;
+    case QBsdFbDevice::XRGB1555:
+        m_convert = convertPixels<Rgb32ToXrgb1555Pixel>;
+        m_rotate = rotatePixels<Rgb32ToXrgb1555Pixel>;
+        m_name = "rgb32-xrgb1555";
+        break;
+    case QBsdFbDevice::XBGR1555:
+        m_convert = convertPixels<Rgb32ToXbgr1555Pixel>;
+        m_rotate = rotatePixels<Rgb32ToXbgr1555Pixel>;
+        m_name = "rgb32-xbgr1555";
+        break;
+    case QBsdFbDevice::BGR565:
+        m_convert = convertPixels<Rgb32ToBgr565Pixel>;
+        m_rotate = rotatePixels<Rgb32ToBgr565Pixel>;
+        m_name = "rgb32-bgr565";
+        break;
+    case QBsdFbDevice::RGB888:
+        m_convert = convertPixels<Rgb32ToBgrPixel>;
+        m_rotate = rotatePixels<Rgb32ToBgrPixel>;
+        m_name = "rgb32-rgb888";
+        break;
+    case QBsdFbDevice::XBGR8888:
+        m_convert = convertPixels<Rgb32ToXbgr8888Pixel>;
+        m_rotate = rotatePixels<Rgb32ToXbgr8888Pixel>;
+        m_name = "rgb32-xbgr8888";
+#if QT_COMPILER_SUPPORTS_HERE(SSE2)
+        if (qCpuHasFeature(SSE2)) {
+            m_convert = convertRgb32ToXbgr8888_sse2;
+            m_name = "rgb32-xbgr8888-sse2";
+        }
+#endif
+        break;
+    case QBsdFbDevice::XRGB2101010:
+        m_convert = convertPixels<Rgb32ToXrgb2101010Pixel>;
+        m_rotate = rotatePixels<Rgb32ToXrgb2101010Pixel>;
+        m_name = "rgb32-xrgb2101010";
+        break;
+    case QBsdFbDevice::XBGR2101010:
+        m_convert = convertPixels<Rgb32ToXbgr2101010Pixel>;
+        m_rotate = rotatePixels<Rgb32ToXbgr2101010Pixel>;
+        m_name = "rgb32-xbgr2101010";
+        break;
+    case QBsdFbDevice::RGB565:
+        m_convert = convertRgb32ToRgb16;
+        m_rotate = rotatePixels<Rgb32ToRgb16Pixel>;
+        m_name = "rgb32-rgb16";
+#if defined(__ARM_NEON__)
+        m_convert = convertRgb32ToRgb16_neon;
+        m_name = "rgb32-rgb16-neon";
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(SSE2)
+        if (qCpuHasFeature(SSE2)) {
+            m_convert = convertRgb32ToRgb16_sse2;
+            m_name = "rgb32-rgb16-sse2";
+        }
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(AVX2)
+        if (qCpuHasFeature(AVX2)) {
+            m_convert = convertRgb32ToRgb16_avx2;
+            m_name = "rgb32-rgb16-avx2";
+        }
+#endif
+        break;
+    case QBsdFbDevice::BGR888:
+        m_convert = convertRgb32ToRgb888;
+        m_rotate = rotatePixels<Rgb32ToRgb888Pixel>;
+        m_name = "rgb32-bgr888";
+#if defined(__ARM_NEON__)
+        m_convert = convertRgb32ToRgb888_neon;
+        m_name = "rgb32-bgr888-neon";
+#endif
+        break;
+    default:
+        break;
+    }
+
+    return m_convert != nullptr;
+}
+
+// Only affects C8 framebuffers. RGB332 is converted arithmetically, any
+// other palette through a table built here once.
+void QBsdFbBlitter::setPalette(const QVector<QRgb> &palette)
+{
+    if (m_targetBytesPerPixel != 1 || m_convert == copyPixels<1> || palette.isEmpty())
+        return;
+
+    if (palette == QBsdFbDevice::rgb332Palette()) {
+        m_convert = convertPixels<Rgb32ToRgb332Pixel>;
+        m_rotate = rotatePixels<Rgb32ToRgb332Pixel>;
+        m_name = "rgb32-rgb332";
+        return;
+    }
+
+    for (int i = 0; i < 32768; ++i) {
+        // Centre of the RGB555 cell
+        const int r = ((i >> 10) & 0x1f) * 8 + 4;
+        const int g = ((i >> 5) & 0x1f) * 8 + 4;
+        const int b = (i & 0x1f) * 8 + 4;
+        int best = 0;
+        int bestDistance = INT_MAX;
+        for (int n = 0; n < palette.size() && bestDistance; ++n) {
+            const int dr = qRed(palette.at(n)) - r;
+            const int dg = qGreen(palette.at(n)) - g;
+            const int db = qBlue(palette.at(n)) - b;
+            const int distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance) {
+                best = n;
+                bestDistance = distance;
+            }
+        }
+        paletteLookup[i] = best;
+    }
+
+    m_convert = convertPixels<Rgb32ToPalettePixel>;
+    m_rotate = rotatePixels<Rgb32ToPalettePixel>;
+    m_name = "rgb32-c8-lookup";
+}
+
+void QBsdFbBlitter::setScale(int factor, int maxWidth, int slots)
+{
+    m_scale = factor;
+    m_expand = nullptr;
+    m_scaleRows.clear();
+    m_scaleRowBytes = 0;
+    m_scaleMaxWidth = 0;
+    if (factor <= 1)
+        return;
+
+    // Rounded up to whole cache lines, so that slots used by different
+    // threads never share one
+    m_scaleMaxWidth = maxWidth;
+    m_scaleRowBytes = (maxWidth * m_targetBytesPerPixel * (1 + factor) + 63) & ~63;
+    m_scaleRows.resize(m_scaleRowBytes * qMax(1, slots));
+
+    switch (m_targetBytesPerPixel) {
+    case 4:
+        m_expand = expandPixels<4>;
+#if defined(__ARM_NEON__)
+        m_expand = expandPixels32_neon;
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(SSE2)
+        if (qCpuHasFeature(SSE2))
+            m_expand = expandPixels32_sse2;
+#endif
+        break;
+    case 3:
+        m_expand = expandPixels<3>;
+        break;
+    case 2:
+        m_expand = expandPixels<2>;
+#if defined(__ARM_NEON__)
+        m_expand = expandPixels16_neon;
+#endif
+#if QT_COMPILER_SUPPORTS_HERE(SSE2)
+        if (qCpuHasFeature(SSE2))
+            m_expand = expandPixels16_sse2;
+#endif
+        break;
+    case 1:
+        m_expand = expandPixels<1>;
+        break;
+    }
+}
+
+bool QBsdFbBlitter::setStreaming(bool enabled)
+{
+    m_stream = nullptr;
+#if QT_COMPILER_SUPPORTS_HERE(SSE2)
+    if (enabled && qCpuHasFeature(SSE2))
+        m_stream = streamBytes_sse2;
+#else
+    Q_UNUSED(enabled);
+#endif
+    return m_stream != nullptr;
+}
+
+// rotation is clockwise in degrees and logicalSize the size of the screen
+// as seen by Qt, i.e. after rotating
+void QBsdFbBlitter::setRotation(int rotation, const QSize &logicalSize)
+{
+    m_rotation = rotation;
+    m_logicalSize = logicalSize;
+}
+
+void QBsdFbBlitter::blit(uchar *target, int targetBytesPerLine, const QImage &source, const QRect &rect,
+                         const QPoint &to, int slot) const
+{
+    const int width = rect.width();
+    const int sbpl = source.bytesPerLine();
+    const int dbpl = targetBytesPerLine;
+    const uchar *src = source.constBits() + rect.y() * sbpl + rect.x() * m_sourceBytesPerPixel;
+
+    if (m_rotation) {
+        blitRotated(target, dbpl, src, sbpl, rect.size(), to);
+        return;
+    }
+
+    if (m_scale > 1) {
+        blitScaled(target, dbpl, src, sbpl, rect.size(), to, slot);
+        return;
+    }
+
+    uchar *dst = target + to.y() * dbpl + to.x() * m_targetBytesPerPixel;
+
+    if (isSingleSpan(width, sbpl, dbpl)) {
+        convertSpan(dst, src, width * rect.height());
+        return;
+    }
+
+    for (int y = 0; y < rect.height(); ++y) {
+        convertSpan(dst, src, width);
+        src += sbpl;
+        dst += dbpl;
+    }
+}
+
+// Long spans are written with non-temporal stores. Converted pixels are
+// staged a chunk at a time in a buffer that stays in L1.
+inline void QBsdFbBlitter::convertSpan(uchar *dst, const uchar *src, int count) const
+{
+    const size_t bytes = size_t(count) * m_targetBytesPerPixel;
+    if (!m_stream || bytes < StreamBytes) {
+        m_convert(dst, src, count);
+        return;
+    }
+
+    if (m_copy) {
+        m_stream(dst, src, bytes);
+        return;
+    }
+
+    uchar buffer[StreamChunk * 4];
+    while (count > 0) {
+        const int n = qMin(count, int(StreamChunk));
+        m_convert(buffer, src, n);
+        m_stream(dst, buffer, size_t(n) * m_targetBytesPerPixel);
+        dst += n * m_targetBytesPerPixel;
+        src += n * m_sourceBytesPerPixel;
+        count -= n;
+    }
+}
+
+// src points at the top left source pixel. Finds the framebuffer rect the
+// logical rect at to maps to, and which source pixel lands on its top
+// left corner.
+void QBsdFbBlitter::blitRotated(uchar *target, int targetBytesPerLine, const uchar *src, int sbpl,
+                                const QSize &size, const QPoint &to) const
+{
+    const int w = size.width();
+    const int h = size.height();
+    const int sbpp = m_sourceBytesPerPixel;
+    int x, y, width, height;
+    qptrdiff stepX, stepY;
+
+    switch (m_rotation) {
+    case 90:
+        x = m_logicalSize.height() - to.y() - h;
+        y = to.x();
+        width = h;
+        height = w;
+        src += qptrdiff(h - 1) * sbpl;
+        stepX = -sbpl;
+        stepY = sbpp;
+        break;
+    case 180:
+        x = m_logicalSize.width() - to.x() - w;
+        y = m_logicalSize.height() - to.y() - h;
+        width = w;
+        height = h;
+        src += qptrdiff(h - 1) * sbpl + (w - 1) * sbpp;
+        stepX = -sbpp;
+        stepY = -sbpl;
+        break;
+    case 270:
+        x = to.y();
+        y = m_logicalSize.width() - to.x() - w;
+        width = h;
+        height = w;
+        src += (w - 1) * sbpp;
+        stepX = sbpl;
+        stepY = -sbpp;
+        break;
+    default:
+        return;
+    }
+
+    uchar *dst = target + y * targetBytesPerLine + x * m_targetBytesPerPixel;
+    m_rotate(dst, targetBytesPerLine, src, stepX, stepY, width, height);
+}
+
+// Each source row is converted and expanded once into cached memory and
+// then copied to factor framebuffer rows, which are never read back.
+void QBsdFbBlitter::blitScaled(uchar *target, int targetBytesPerLine, const uchar *src, int sbpl,
+                               const QSize &size, const QPoint &to, int slot) const
+{
+    Q_ASSERT(size.width() <= m_scaleMaxWidth);
+    Q_ASSERT((slot + 1) * m_scaleRowBytes <= m_scaleRows.size());
+
+    const int width = size.width();
+    const int rowBytes = width * m_scale * m_targetBytesPerPixel;
+    uchar *converted = m_scaleRows.data() + slot * m_scaleRowBytes;
+    uchar *expanded = converted + width * m_targetBytesPerPixel;
+
+    uchar *dst = target + to.y() * m_scale * targetBytesPerLine + to.x() * m_scale * m_targetBytesPerPixel;
+    for (int y = 0; y < size.height(); ++y) {
+        m_convert(converted, src, width);
+        m_expand(expanded, converted, width, m_scale);
+        for (int n = 0; n < m_scale; ++n) {
+            if (m_stream && rowBytes >= StreamBytes)
+                m_stream(dst, expanded, rowBytes);
+            else
+                memcpy(dst, expanded, rowBytes);
+            dst += targetBytesPerLine;
+        }
+        src += sbpl;
+    }
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,125 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBBLITTER_H
+#define QBSDFBBLITTER_H
+
+#include "qbsdfbdevice.h"
+
+#include <QtGui/QImage>
+
+QT_BEGIN_NAMESPACE
+
+// Copies rectangles between the composed screen image and the framebuffer,
+// converting the pixel format on the way. The row kernel is picked once per
+// format pair, using the widest instruction set the CPU supports. Every
+// framebuffer layout has its own kernel instantiated from a pixel template,
+// C8 framebuffers are matched through a colour lookup table when their
+// palette is not the RGB332 one bsdfb loads.
+//
+// With a rotation set, positions are in the rotated, logical screen of the
+// given size and the framebuffer is written in tiles, so that turning
+// columns into rows stays within a few cache lines on either side. With a
+// scale factor every logical pixel becomes a factor x factor block; the
+// rows it goes through are allocated once per blit slot by setScale(), so
+// concurrent blits must pass distinct slots.
+//
+// Long spans can be written with non-temporal stores, which keep the
+// composed frame in the cache instead of the framebuffer lines that are
+// never read back.
+class QBsdFbBlitter
+{
+public:
+    typedef void (*ConvertFunc)(uchar *dst, const uchar *src, int count);
+    typedef void (*RotateFunc)(uchar *dst, int dbpl, const uchar *src, qptrdiff stepX, qptrdiff stepY,
+                               int width, int height);
+    typedef void (*ExpandFunc)(uchar *dst, const uchar *src, int count, int factor);
+    typedef void (*StreamFunc)(uchar *dst, const uchar *src, size_t bytes);
+
+    bool setFormats(QImage::Format source, QBsdFbDevice::PixelLayout target);
+    void setPalette(const QVector<QRgb> &palette);
+    void setRotation(int rotation, const QSize &logicalSize);
+    void setScale(int factor, int maxWidth, int slots = 1);
+    // Returns false if the CPU has no non-temporal stores
+    bool setStreaming(bool enabled);
+
+    bool isValid() const { return m_convert != nullptr; }
+    const char *name() const { return m_name; }
+    int rotation() const { return m_rotation; }
+    int scale() const { return m_scale; }
+    bool isStreaming() const { return m_stream != nullptr; }
+    // Whether blit() converts all rows of a rect as one span, which needs
+    // full rows without padding on either side
+    bool isSingleSpan(int width, int sourceBytesPerLine, int targetBytesPerLine) const
+    {
+        return !m_rotation && m_scale <= 1
+                && width * m_sourceBytesPerPixel == sourceBytesPerLine
+                && width * m_targetBytesPerPixel == targetBytesPerLine;
+    }
+
+    void blit(uchar *target, int targetBytesPerLine, const QImage &source, const QRect &rect,
+              int slot = 0) const
+    {
+        blit(target, targetBytesPerLine, source, rect, rect.topLeft(), slot);
+    }
+    void blit(uchar *target, int targetBytesPerLine, const QImage &source, const QRect &rect,
+              const QPoint &to, int slot = 0) const;
+
+private:
+    void convertSpan(uchar *dst, const uchar *src, int count) const;
+    void blitRotated(uchar *target, int targetBytesPerLine, const uchar *src, int sbpl,
+                     const QSize &size, const QPoint &to) const;
+    void blitScaled(uchar *target, int targetBytesPerLine, const uchar *src, int sbpl,
+                    const QSize &size, const QPoint &to, int slot) const;
+
+    ConvertFunc m_convert = nullptr;
+    RotateFunc m_rotate = nullptr;
+    ExpandFunc m_expand = nullptr;
+    StreamFunc m_stream = nullptr;
+    bool m_copy = false;
+    int m_rotation = 0;
+    int m_scale = 1;
+    QSize m_logicalSize;
+    // Converted and expanded row per slot, written by const blits
+    mutable QVector<uchar> m_scaleRows;
+    int m_scaleRowBytes = 0;
+    int m_scaleMaxWidth = 0;
+    int m_sourceBytesPerPixel = 0;
+    int m_targetBytesPerPixel = 0;
+    const char *m_name = "none";
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBBLITTER_H
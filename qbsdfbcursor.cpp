@@ -0,0 +1,194 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbcursor.h"
+#include "qbsdfbscreen.h"
+
+#include <QtGui/QBitmap>
+#include <QtGui/QCursor>
+#include <QtGui/QMouseEvent>
+#include <QtGui/private/qguiapplication_p.h>
+#include <QtPlatformSupport/private/qinputdevicemanager_p.h>
+
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+QBsdFbCursor::QBsdFbCursor(QBsdFbScreen *screen)
+    : m_screen(screen),
+      m_visible(!qEnvironmentVariableIntValue("QT_QPA_FB_HIDECURSOR"))
+#ifndef QT_NO_CURSOR
+      , m_cursorImage(nullptr, nullptr, 0, 0, 0, 0)
+#endif
+{
+#ifndef QT_NO_CURSOR
+    m_cursorImage.set(Qt::ArrowCursor);
+    setImage(*m_cursorImage.image(), m_cursorImage.hotspot());
+#endif
+}
+
+void QBsdFbCursor::pointerEvent(const QMouseEvent &event)
+{
+    if (event.type() != QEvent::MouseMove)
+        return;
+
+    const QPoint pos = event.screenPos().toPoint();
+    const auto cursors = siblings();
+    for (QBsdFbCursor *cursor : cursors)
+        cursor->move(pos);
+}
+
+#ifndef QT_NO_CURSOR
+// QPlatformCursorImage::set() reads rows of (width + 7) / 8 bytes, while
+// QImage pads every scanline to 32 bits
+static QByteArray packedRows(const QImage &image)
+{
+    const int bytesPerRow = (image.width() + 7) / 8;
+    QByteArray packed(bytesPerRow * image.height(), Qt::Uninitialized);
+    for (int y = 0; y < image.height(); ++y)
+        memcpy(packed.data() + y * bytesPerRow, image.constScanLine(y), bytesPerRow);
+    return packed;
+}
+
+void QBsdFbCursor::changeCursor(QCursor *cursor, QWindow *window)
+{
+    Q_UNUSED(window);
+
+    QImage image;
+    QPoint hotSpot;
+    const Qt::CursorShape shape = cursor ? cursor->shape() : Qt::ArrowCursor;
+    if (shape == Qt::BitmapCursor && !cursor->pixmap().isNull()) {
+        image = cursor->pixmap().toImage();
+        hotSpot = cursor->hotSpot();
+    } else if (shape == Qt::BitmapCursor) {
+        const QImage bitmap = cursor->bitmap()->toImage().convertToFormat(QImage::Format_Mono);
+        const QImage mask = cursor->mask()->toImage().convertToFormat(QImage::Format_Mono);
+        hotSpot = cursor->hotSpot();
+        const QByteArray bitmapRows = packedRows(bitmap);
+        const QByteArray maskRows = packedRows(mask.copy(bitmap.rect()));
+        m_cursorImage.set(reinterpret_cast<const uchar *>(bitmapRows.constData()),
+                          reinterpret_cast<const uchar *>(maskRows.constData()),
+                          bitmap.width(), bitmap.height(), hotSpot.x(), hotSpot.y());
+        image = *m_cursorImage.image();
+    } else {
+        m_cursorImage.set(shape);
+        image = *m_cursorImage.image();
+        hotSpot = m_cursorImage.hotspot();
+    }
+
+    const auto cursors = siblings();
+    for (QBsdFbCursor *sibling : cursors)
+        sibling->setImage(image, hotSpot);
+}
+#endif
+
+QPoint QBsdFbCursor::pos() const
+{
+    return m_pos;
+}
+
+void QBsdFbCursor::setPos(const QPoint &pos)
+{
+    QGuiApplicationPrivate::inputDeviceManager()->setCursorPos(pos);
+
+    const auto cursors = siblings();
+    for (QBsdFbCursor *cursor : cursors)
+        cursor->move(pos);
+}
+
+// The pointer is shared by all screens of the virtual desktop and only
+// shown on the one it is over
+QList<QBsdFbCursor *> QBsdFbCursor::siblings() const
+{
+    QList<QBsdFbCursor *> cursors;
+    const auto screens = m_screen->virtualSiblings();
+    for (QPlatformScreen *screen : screens) {
+        if (QBsdFbCursor *cursor = static_cast<QBsdFbScreen *>(screen)->planeCursor())
+            cursors.append(cursor);
+    }
+    return cursors;
+}
+
+QRect QBsdFbCursor::rectAt(const QPoint &pos) const
+{
+    if (!m_visible || m_image.isNull() || !m_screen->geometry().contains(pos))
+        return QRect();
+    return QRect(pos - m_screen->geometry().topLeft() - m_hotSpot, m_image.size());
+}
+
+void QBsdFbCursor::move(const QPoint &pos)
+{
+    m_pos = pos;
+
+    const QRect rect = rectAt(pos);
+    if (rect == m_rect)
+        return;
+
+    {
+        QMutexLocker locker(&m_lock);
+        m_rect = rect;
+    }
+    m_changed = true;
+    m_screen->updateCursor();
+}
+
+void QBsdFbCursor::setImage(const QImage &image, const QPoint &hotSpot)
+{
+    const QImage converted = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    {
+        QMutexLocker locker(&m_lock);
+        m_image = converted;
+        m_hotSpot = hotSpot;
+        m_rect = rectAt(m_pos);
+    }
+    m_changed = true;
+    m_screen->updateCursor();
+}
+
+void QBsdFbCursor::state(QImage *image, QRect *rect) const
+{
+    QMutexLocker locker(&m_lock);
+    *image = m_image;
+    *rect = m_rect;
+}
+
+// Whether the cursor changed since the last frame was submitted
+bool QBsdFbCursor::takeChanged()
+{
+    const bool changed = m_changed;
+    m_changed = false;
+    return changed;
+}
+
+QT_END_NAMESPACE
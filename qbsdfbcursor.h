@@ -0,0 +1,90 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBCURSOR_H
+#define QBSDFBCURSOR_H
+
+#include <qpa/qplatformcursor.h>
+#include <QtCore/QMutex>
+#include <QtGui/QImage>
+
+QT_BEGIN_NAMESPACE
+
+class QBsdFbScreen;
+
+// A cursor that is never composed into the screen image. QBsdFbScreen
+// stamps it over the framebuffer while presenting, so moving it only
+// rewrites the old and new cursor rects.
+class QBsdFbCursor : public QPlatformCursor
+{
+public:
+    explicit QBsdFbCursor(QBsdFbScreen *screen);
+
+    void pointerEvent(const QMouseEvent &event) override;
+#ifndef QT_NO_CURSOR
+    void changeCursor(QCursor *cursor, QWindow *window) override;
+#endif
+    QPoint pos() const override;
+    void setPos(const QPoint &pos) override;
+
+    // Rect in screen coordinates, empty while the cursor is hidden. May be
+    // called from the presenter thread.
+    void state(QImage *image, QRect *rect) const;
+
+    bool isVisible() const { return m_visible; }
+    bool takeChanged();
+
+private:
+    QList<QBsdFbCursor *> siblings() const;
+    QRect rectAt(const QPoint &pos) const;
+    void move(const QPoint &pos);
+    void setImage(const QImage &image, const QPoint &hotSpot);
+
+    QBsdFbScreen *m_screen;
+    QPoint m_pos;
+    QPoint m_hotSpot;
+    bool m_visible;
+    bool m_changed = false;
+#ifndef QT_NO_CURSOR
+    QPlatformCursorImage m_cursorImage;
+#endif
+
+    mutable QMutex m_lock;
+    QImage m_image;
+    QRect m_rect;
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBCURSOR_H
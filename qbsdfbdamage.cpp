@@ -0,0 +1,85 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbdamage.h"
+
+QT_BEGIN_NAMESPACE
+
+enum {
+    // Only the most recently merged rects are tried, which keeps heavily
+    // fragmented regions from making the merge quadratic
+    MaxMergeCandidates = 32
+};
+
+static inline qint64 area(const QRect &rect)
+{
+    return qint64(rect.width()) * rect.height();
+}
+
+QVector<QRect> QBsdFbDamageOptimizer::optimize(const QRegion &region) const
+{
+    QVector<QRect> rects = region.rects();
+    if (m_wasteRatio <= 0 || rects.size() < 2)
+        return rects;
+
+    // The rects of a QRegion do not overlap, so the damaged area of a
+    // merged rect is the sum of the areas that went into it.
+    QVector<QRect> merged;
+    QVector<qint64> damaged;
+    merged.reserve(rects.size());
+    damaged.reserve(rects.size());
+
+    for (const QRect &rect : qAsConst(rects)) {
+        bool done = false;
+        const int first = qMax(0, merged.size() - MaxMergeCandidates);
+        for (int i = merged.size() - 1; i >= first; --i) {
+            const QRect candidate = merged.at(i).united(rect);
+            const qint64 used = damaged.at(i) + area(rect);
+            if (area(candidate) - used <= m_wasteRatio * area(candidate)) {
+                merged[i] = candidate;
+                damaged[i] = used;
+                done = true;
+                break;
+            }
+        }
+        if (!done) {
+            merged.append(rect);
+            damaged.append(area(rect));
+        }
+    }
+
+    return merged;
+}
+
+QT_END_NAMESPACE
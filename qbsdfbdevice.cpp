@@ -0,0 +1,421 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbdevice.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QRegularExpression>
+
+#include <private/qcore_unix_p.h> // overrides QT_OPEN
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+#if defined(Q_OS_FREEBSD)
+#include <sys/consio.h>
+#include <sys/fbio.h>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+QBsdFbDevice::~QBsdFbDevice()
+{
+    unmap();
+    if (m_fd != -1)
+        qt_safe_close(m_fd);
+}
+
+QBsdFbDevice *QBsdFbDevice::create(const QString &spec)
+{
+    if (spec.startsWith(QLatin1String("virtual")))
+        return new QBsdFbVirtualDevice(spec);
+    return new QBsdFbConsoleDevice(spec);
+}
+
+static const struct {
+    const char *name;
+    int bytesPerPixel;
+    QImage::Format format;
+} layouts[] = {
+    { "unknown", 0, QImage::Format_Invalid },
+    { "c8", 1, QImage::Format_Indexed8 },
+    { "xrgb1555", 2, QImage::Format_RGB555 },
+    { "xbgr1555", 2, QImage::Format_Invalid },
+    { "rgb565", 2, QImage::Format_RGB16 },
+    { "bgr565", 2, QImage::Format_Invalid },
+    { "rgb888", 3, QImage::Format_Invalid },
+    { "bgr888", 3, QImage::Format_RGB888 },
+    { "xrgb8888", 4, QImage::Format_RGB32 },
+    { "xbgr8888", 4, QImage::Format_RGBX8888 },
+    { "xrgb2101010", 4, QImage::Format_RGB30 },
+    { "xbgr2101010", 4, QImage::Format_BGR30 }
+};
+Q_STATIC_ASSERT(sizeof(layouts) / sizeof(*layouts) == QBsdFbDevice::XBGR2101010 + 1);
+
+int QBsdFbDevice::bytesPerPixel(PixelLayout layout)
+{
+    return layouts[layout].bytesPerPixel;
+}
+
+QImage::Format QBsdFbDevice::imageFormat(PixelLayout layout)
+{
+    return layouts[layout].format;
+}
+
+const char *QBsdFbDevice::layoutName(PixelLayout layout)
+{
+    return layouts[layout].name;
+}
+
+// The palette bsdfb loads into C8 framebuffers, so that converting to it
+// needs no lookup
+QVector<QRgb> QBsdFbDevice::rgb332Palette()
+{
+    QVector<QRgb> palette(256);
+    for (int i = 0; i < 256; ++i) {
+        const int r = (i >> 5) & 7;
+        const int g = (i >> 2) & 7;
+        const int b = i & 3;
+        palette[i] = qRgb(r * 255 / 7, g * 255 / 7, b * 255 / 3);
+    }
+    return palette;
+}
+
+// What a depth meant before the layout could be queried
+static QBsdFbDevice::PixelLayout layoutForDepth(int depth)
+{
+    switch (depth) {
+    case 8:
+        return QBsdFbDevice::C8;
+    case 15:
+        return QBsdFbDevice::XRGB1555;
+    case 16:
+        return QBsdFbDevice::RGB565;
+    case 24:
+        return QBsdFbDevice::BGR888;
+    case 30:
+        return QBsdFbDevice::XRGB2101010;
+    case 32:
+        return QBsdFbDevice::XRGB8888;
+    default:
+        return QBsdFbDevice::UnknownLayout;
+    }
+}
+
+// Offsets and sizes in bits of the red, green and blue fields
+static QBsdFbDevice::PixelLayout layoutForChannels(int bitsPerPixel, const int offset[3], const int size[3])
+{
+    const bool rgb = offset[0] > offset[2];
+    const int r = size[0], g = size[1], b = size[2];
+
+    if (bitsPerPixel == 16 && r == 5 && g == 6 && b == 5)
+        return rgb ? QBsdFbDevice::RGB565 : QBsdFbDevice::BGR565;
+    if ((bitsPerPixel == 15 || bitsPerPixel == 16) && r == 5 && g == 5 && b == 5)
+        return rgb ? QBsdFbDevice::XRGB1555 : QBsdFbDevice::XBGR1555;
+    if (bitsPerPixel == 24 && r == 8 && g == 8 && b == 8)
+        return rgb ? QBsdFbDevice::RGB888 : QBsdFbDevice::BGR888;
+    if (bitsPerPixel == 32 && r == 8 && g == 8 && b == 8)
+        return rgb ? QBsdFbDevice::XRGB8888 : QBsdFbDevice::XBGR8888;
+    if (bitsPerPixel == 32 && r == 10 && g == 10 && b == 10)
+        return rgb ? QBsdFbDevice::XRGB2101010 : QBsdFbDevice::XBGR2101010;
+    return QBsdFbDevice::UnknownLayout;
+}
+
+// Pans the visible area within the device memory, used for page flipping
+bool QBsdFbDevice::setDisplayStart(int x, int y)
+{
+    Q_UNUSED(x);
+    Q_UNUSED(y);
+    return false;
+}
+
+// With prefault every page is mapped before this returns instead of on
+// the first write of each, which would otherwise land in the first frames
+uchar *QBsdFbDevice::map(bool prefault)
+{
+    if (m_data)
+        return m_data;
+
+    const size_t pageSize = getpagesize();
+    const size_t size = (m_memorySize + pageSize - 1) & ~(pageSize - 1);
+    int flags = MAP_SHARED;
+#if defined(MAP_PREFAULT_READ)
+    if (prefault)
+        flags |= MAP_PREFAULT_READ;
+#elif defined(MAP_POPULATE)
+    if (prefault)
+        flags |= MAP_POPULATE;
+#endif
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, m_fd, 0);
+    if (data == MAP_FAILED) {
+        qErrnoWarning(errno, "Failed to mmap framebuffer");
+        return nullptr;
+    }
+
+    m_data = static_cast<uchar *>(data);
+    m_mappedSize = size;
+
+    // Not every pager honours the flags above. Reading keeps the contents
+    // and still installs the mapping, which is all a write needs for
+    // device memory.
+    if (prefault) {
+        const volatile uchar *touch = m_data;
+        for (size_t offset = 0; offset < size; offset += pageSize)
+            (void)touch[offset];
+    }
+
+    return m_data;
+}
+
+void QBsdFbDevice::unmap()
+{
+    if (!m_data)
+        return;
+
+    munmap(m_data, m_mappedSize);
+    m_data = nullptr;
+    m_mappedSize = 0;
+}
+
+#if defined(Q_OS_FREEBSD)
+static int openFramebufferDevice(const QString &dev)
+{
+    const QByteArray devPath = QFile::encodeName(dev);
+
+    int fd = QT_OPEN(devPath.constData(), O_RDWR);
+
+    if (fd == -1)
+        fd = QT_OPEN(devPath.constData(), O_RDONLY);
+
+    return fd;
+}
+#endif
+
+bool QBsdFbConsoleDevice::open()
+{
+#if defined(Q_OS_FREEBSD)
+    if (!m_name.isEmpty()) {
+        // Open the device
+        m_fd = openFramebufferDevice(m_name);
+    } else {
+        m_fd = STDIN_FILENO;
+    }
+
+    if (m_fd == -1) {
+        qErrnoWarning(errno, "Failed to open framebuffer %s", qPrintable(m_name));
+        return false;
+    }
+
+    struct fbtype fb;
+    if (ioctl(m_fd, FBIOGTYPE, &fb) != 0) {
+        qErrnoWarning(errno, "Error reading framebuffer information");
+        return false;
+    }
+
+    int line_length = 0;
+    if (ioctl(m_fd, FBIO_GETLINEWIDTH, &line_length) != 0) {
+        qErrnoWarning(errno, "Error reading line length information");
+        return false;
+    }
+
+    m_size = QSize(fb.fb_width, fb.fb_height);
+    m_depth = fb.fb_depth;
+    m_bytesPerLine = line_length;
+    m_layout = layoutForDepth(m_depth);
+
+#if defined(FBIO_GETMODE) && defined(FBIO_MODEINFO)
+    // Drivers that describe their mode tell where the channels are
+    int mode;
+    video_info_t info;
+    memset(&info, 0, sizeof(info));
+    if (ioctl(m_fd, FBIO_GETMODE, &mode) == 0) {
+        info.vi_mode = mode;
+        if (ioctl(m_fd, FBIO_MODEINFO, &info) == 0 && info.vi_mem_model == V_INFO_MM_DIRECT) {
+            const int offset[3] = { info.vi_pixel_fields[0], info.vi_pixel_fields[1], info.vi_pixel_fields[2] };
+            const int size[3] = { info.vi_pixel_fsizes[0], info.vi_pixel_fsizes[1], info.vi_pixel_fsizes[2] };
+            const PixelLayout layout = layoutForChannels(info.vi_pixel_size * 8, offset, size);
+            if (layout != UnknownLayout) {
+                m_layout = layout;
+            } else {
+                qWarning("bsdfb: Unsupported channel layout R%d@%d G%d@%d B%d@%d",
+                         size[0], offset[0], size[1], offset[1], size[2], offset[2]);
+            }
+        }
+    }
+#endif
+
+    if (m_layout == C8) {
+        m_palette = rgb332Palette();
+#if defined(FBIOPUTCMAP) && defined(FBIOGETCMAP)
+        u_char red[256], green[256], blue[256];
+        for (int i = 0; i < 256; ++i) {
+            red[i] = qRed(m_palette.at(i));
+            green[i] = qGreen(m_palette.at(i));
+            blue[i] = qBlue(m_palette.at(i));
+        }
+        struct fbcmap cmap;
+        cmap.index = 0;
+        cmap.count = 256;
+        cmap.red = red;
+        cmap.green = green;
+        cmap.blue = blue;
+
+        // A fixed palette has to be matched instead
+        if (ioctl(m_fd, FBIOPUTCMAP, &cmap) != 0) {
+            if (ioctl(m_fd, FBIOGETCMAP, &cmap) == 0) {
+                for (int i = 0; i < 256; ++i)
+                    m_palette[i] = qRgb(red[i], green[i], blue[i]);
+            } else {
+                qWarning("bsdfb: Could not access the palette, colors will be wrong");
+            }
+        }
+#endif
+    }
+    // Memory beyond the visible lines is what panning can flip into
+    m_virtualHeight = line_length > 0 ? qMax(fb.fb_height, int(fb.fb_size / line_length)) : fb.fb_height;
+    m_memorySize = size_t(line_length) * m_virtualHeight;
+    return true;
+#else
+    qWarning("bsdfb: Console framebuffers are not supported on this platform, use fb=virtual");
+    return false;
+#endif
+}
+
+bool QBsdFbConsoleDevice::setDisplayStart(int x, int y)
+{
+#if defined(FBIO_SETDISPSTART)
+    video_display_start_t start;
+    start.x = x;
+    start.y = y;
+    return ioctl(m_fd, FBIO_SETDISPSTART, &start) == 0;
+#else
+    return QBsdFbDevice::setDisplayStart(x, y);
+#endif
+}
+
+static int createAnonymousFile()
+{
+#if defined(MFD_CLOEXEC)
+    return memfd_create("qbsdfb", MFD_CLOEXEC);
+#elif defined(SHM_ANON)
+    return shm_open(SHM_ANON, O_RDWR | O_CLOEXEC, 0600);
+#else
+    QByteArray path = QFile::encodeName(QDir::tempPath()) + "/qbsdfb-XXXXXX";
+    const int fd = mkstemp(path.data());
+    if (fd != -1)
+        unlink(path.constData());
+    return fd;
+#endif
+}
+
+bool QBsdFbVirtualDevice::open()
+{
+    QRegularExpression specRx(QLatin1String("^virtual,(\\d+)x(\\d+)x(\\d+)(?:,pages=(\\d+))?(?:,layout=(\\w+))?(?:,(.+))?$"));
+    const QRegularExpressionMatch match = specRx.match(m_name);
+    if (!match.hasMatch()) {
+        qWarning("bsdfb: Invalid virtual framebuffer '%s', expected virtual,<w>x<h>x<depth>[,pages=<n>][,layout=<name>][,<file>]",
+                 qPrintable(m_name));
+        return false;
+    }
+
+    const int width = match.captured(1).toInt();
+    const int height = match.captured(2).toInt();
+    const int depth = match.captured(3).toInt();
+    const int pages = match.captured(4).isEmpty() ? 1 : match.captured(4).toInt();
+    const QString layoutName = match.captured(5);
+    const QString file = match.captured(6);
+
+    if (width <= 0 || height <= 0 || depth <= 0 || depth > 32 || pages < 1 || pages > 4) {
+        qWarning("bsdfb: Unsupported virtual framebuffer mode %dx%dx%d", width, height, depth);
+        return false;
+    }
+
+    m_layout = layoutForDepth(depth);
+    if (!layoutName.isEmpty()) {
+        m_layout = UnknownLayout;
+        for (int i = C8; i <= XBGR2101010; ++i) {
+            if (layoutName == QLatin1String(layouts[i].name))
+                m_layout = PixelLayout(i);
+        }
+    }
+    if (m_layout == UnknownLayout || (depth + 7) / 8 != bytesPerPixel(m_layout)) {
+        qWarning("bsdfb: Unsupported virtual framebuffer layout %s for depth %d",
+                 qPrintable(layoutName.isEmpty() ? QString::number(depth) : layoutName), depth);
+        return false;
+    }
+    if (m_layout == C8)
+        m_palette = rgb332Palette();
+
+    if (file.isEmpty())
+        m_fd = createAnonymousFile();
+    else
+        m_fd = qt_safe_open(QFile::encodeName(file).constData(), O_RDWR | O_CREAT, 0644);
+
+    if (m_fd == -1) {
+        qErrnoWarning(errno, "Failed to create virtual framebuffer %s", qPrintable(m_name));
+        return false;
+    }
+
+    m_size = QSize(width, height);
+    m_virtualHeight = height * pages;
+    m_depth = depth;
+    m_bytesPerLine = width * ((depth + 7) / 8);
+    m_memorySize = size_t(m_bytesPerLine) * m_virtualHeight;
+
+    if (ftruncate(m_fd, m_memorySize) != 0) {
+        qErrnoWarning(errno, "Failed to resize virtual framebuffer %s", qPrintable(m_name));
+        return false;
+    }
+
+    return true;
+}
+
+bool QBsdFbVirtualDevice::setDisplayStart(int x, int y)
+{
+    if (x != 0 || y < 0 || y + m_size.height() > m_virtualHeight)
+        return false;
+
+    m_displayStart = QPoint(x, y);
+    return true;
+}
+
+QT_END_NAMESPACE
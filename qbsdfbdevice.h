@@ -0,0 +1,142 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBDEVICE_H
+#define QBSDFBDEVICE_H
+
+#include <QtCore/QPoint>
+#include <QtCore/QSize>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtGui/QImage>
+
+QT_BEGIN_NAMESPACE
+
+// Access to the memory and mode information of a framebuffer. The console
+// backend talks to a FreeBSD framebuffer device through fbio(4) ioctls, the
+// virtual backend provides an anonymous memory (or plain file) framebuffer
+// so the presentation path can be run headless.
+class QBsdFbDevice
+{
+public:
+    // Channel layouts of a framebuffer pixel, named like DRM fourccs: the
+    // most significant channel of the little endian pixel value first
+    enum PixelLayout {
+        UnknownLayout,
+        C8,
+        XRGB1555,
+        XBGR1555,
+        RGB565,
+        BGR565,
+        RGB888,
+        BGR888,
+        XRGB8888,
+        XBGR8888,
+        XRGB2101010,
+        XBGR2101010
+    };
+
+    virtual ~QBsdFbDevice();
+
+    static QBsdFbDevice *create(const QString &spec);
+
+    virtual bool open() = 0;
+    virtual bool setDisplayStart(int x, int y);
+
+    QString name() const { return m_name; }
+    QSize size() const { return m_size; }
+    int virtualHeight() const { return m_virtualHeight; }
+    int depth() const { return m_depth; }
+    int bytesPerLine() const { return m_bytesPerLine; }
+    PixelLayout layout() const { return m_layout; }
+    // Colors of a C8 framebuffer's palette
+    QVector<QRgb> palette() const { return m_palette; }
+
+    static int bytesPerPixel(PixelLayout layout);
+    // The QImage format with the same memory layout, if there is one
+    static QImage::Format imageFormat(PixelLayout layout);
+    static const char *layoutName(PixelLayout layout);
+    static QVector<QRgb> rgb332Palette();
+
+    uchar *map(bool prefault = false);
+    void unmap();
+    uchar *data() const { return m_data; }
+
+protected:
+    explicit QBsdFbDevice(const QString &name) : m_name(name) {}
+
+    QString m_name;
+    int m_fd = -1;
+    QSize m_size;
+    int m_virtualHeight = 0;
+    int m_depth = 0;
+    int m_bytesPerLine = 0;
+    size_t m_memorySize = 0;
+    PixelLayout m_layout = UnknownLayout;
+    QVector<QRgb> m_palette;
+
+private:
+    uchar *m_data = nullptr;
+    size_t m_mappedSize = 0;
+
+    Q_DISABLE_COPY(QBsdFbDevice)
+};
+
+class QBsdFbConsoleDevice : public QBsdFbDevice
+{
+public:
+    explicit QBsdFbConsoleDevice(const QString &device) : QBsdFbDevice(device) {}
+
+    bool open() override;
+    bool setDisplayStart(int x, int y) override;
+};
+
+// Spec: virtual,<width>x<height>x<depth>[,pages=<n>][,layout=<name>][,<file>]
+class QBsdFbVirtualDevice : public QBsdFbDevice
+{
+public:
+    explicit QBsdFbVirtualDevice(const QString &spec) : QBsdFbDevice(spec) {}
+
+    bool open() override;
+    bool setDisplayStart(int x, int y) override;
+
+    QPoint displayStart() const { return m_displayStart; }
+
+private:
+    QPoint m_displayStart;
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBDEVICE_H
@@ -0,0 +1,486 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbeventdispatcher.h"
+
+#if defined(QBSDFB_EVENTDISPATCHER_KQUEUE) || defined(QBSDFB_EVENTDISPATCHER_EPOLL)
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/private/qcoreapplication_p.h>
+#include <QtCore/private/qobject_p.h>
+#include <QtCore/private/qthread_p.h>
+#include <QtGui/QGuiApplication>
+#include <qpa/qwindowsysteminterface.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef QBSDFB_EVENTDISPATCHER_KQUEUE
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#else
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+extern Q_CORE_EXPORT uint qGlobalPostedEventsCount();
+
+static const char *notifierTypeName[] = { "Read", "Write", "Exception" };
+
+int QBsdFbEventDispatcher::Notifiers::mask() const
+{
+    return (notifier[0] ? Read : 0) | (notifier[1] ? Write : 0) | (notifier[2] ? Exception : 0);
+}
+
+QBsdFbEventDispatcher::QBsdFbEventDispatcher(QObject *parent)
+    : QAbstractEventDispatcher(parent)
+{
+#ifdef QBSDFB_EVENTDISPATCHER_KQUEUE
+    m_queue = kqueue();
+    if (m_queue < 0) {
+        qErrnoWarning(errno, "bsdfb: kqueue() failed");
+        return;
+    }
+    ::fcntl(m_queue, F_SETFD, FD_CLOEXEC);
+
+    // Wakeups trigger a user event instead of writing to a pipe
+    struct kevent change;
+    EV_SET(&change, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+    if (kevent(m_queue, &change, 1, nullptr, 0, nullptr) < 0) {
+        qErrnoWarning(errno, "bsdfb: Failed to register the wakeup event");
+        ::close(m_queue);
+        m_queue = -1;
+    }
+#else
+    m_queue = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (m_queue < 0 || m_wakeFd < 0 || m_timerFd < 0) {
+        qErrnoWarning(errno, "bsdfb: Failed to create the epoll event queue");
+        if (m_queue >= 0)
+            ::close(m_queue);
+        m_queue = -1;
+        return;
+    }
+
+    // Notifier fds are stored in data.fd, these two can never collide
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = m_wakeFd;
+    epoll_ctl(m_queue, EPOLL_CTL_ADD, m_wakeFd, &event);
+    event.data.fd = m_timerFd;
+    epoll_ctl(m_queue, EPOLL_CTL_ADD, m_timerFd, &event);
+#endif
+}
+
+QBsdFbEventDispatcher::~QBsdFbEventDispatcher()
+{
+    if (m_queue >= 0)
+        ::close(m_queue);
+#ifdef QBSDFB_EVENTDISPATCHER_EPOLL
+    if (m_wakeFd >= 0)
+        ::close(m_wakeFd);
+    if (m_timerFd >= 0)
+        ::close(m_timerFd);
+#endif
+    qDeleteAll(m_timers);
+}
+
+const char *QBsdFbEventDispatcher::backendName()
+{
+#ifdef QBSDFB_EVENTDISPATCHER_KQUEUE
+    return "kqueue";
+#else
+    return "epoll";
+#endif
+}
+
+bool QBsdFbEventDispatcher::setInterest(int fd, int oldMask, int newMask)
+{
+#ifdef QBSDFB_EVENTDISPATCHER_KQUEUE
+    static const struct {
+        int type;
+        short filter;
+        unsigned int flags;
+    } filters[] = {
+        { Read, EVFILT_READ, 0 },
+        { Write, EVFILT_WRITE, 0 },
+#if defined(EVFILT_EXCEPT) && defined(NOTE_OOB)
+        { Exception, EVFILT_EXCEPT, NOTE_OOB },
+#endif
+    };
+
+    struct kevent changes[3];
+    int count = 0;
+    for (const auto &f : filters) {
+        if ((newMask & f.type) && !(oldMask & f.type))
+            EV_SET(&changes[count++], fd, f.filter, EV_ADD, f.flags, 0, nullptr);
+        else if (!(newMask & f.type) && (oldMask & f.type))
+            EV_SET(&changes[count++], fd, f.filter, EV_DELETE, 0, 0, nullptr);
+    }
+    if (!count)
+        return true;
+
+    // Closing an fd drops its events, so failing to delete them is fine
+    if (kevent(m_queue, changes, count, nullptr, 0, nullptr) < 0)
+        return errno == ENOENT || errno == EBADF;
+    return true;
+#else
+    if (!newMask) {
+        if (epoll_ctl(m_queue, EPOLL_CTL_DEL, fd, nullptr) < 0)
+            return errno == ENOENT || errno == EBADF;
+        return true;
+    }
+
+    epoll_event event;
+    event.events = ((newMask & Read) ? EPOLLIN : 0)
+                 | ((newMask & Write) ? EPOLLOUT : 0)
+                 | ((newMask & Exception) ? EPOLLPRI : 0);
+    event.data.fd = fd;
+    return epoll_ctl(m_queue, oldMask ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) == 0;
+#endif
+}
+
+void QBsdFbEventDispatcher::registerSocketNotifier(QSocketNotifier *notifier)
+{
+    Q_ASSERT(notifier);
+    const int fd = notifier->socket();
+    const int type = notifier->type();
+
+    Notifiers &notifiers = m_notifiers[fd];
+    if (notifiers.notifier[type]) {
+        qWarning("bsdfb: Multiple socket notifiers for same socket %d and type %s",
+                 fd, notifierTypeName[type]);
+    }
+
+#if defined(QBSDFB_EVENTDISPATCHER_KQUEUE) && !(defined(EVFILT_EXCEPT) && defined(NOTE_OOB))
+    if (type == QSocketNotifier::Exception)
+        qWarning("bsdfb: Exception notifiers are not supported by kqueue on this system");
+#endif
+
+    // A suspended fd is not in the kernel queue
+    const int oldMask = m_suspended.removeAll(fd) ? 0 : notifiers.mask();
+    notifiers.notifier[type] = notifier;
+    if (!setInterest(fd, oldMask, notifiers.mask())) {
+        qErrnoWarning(errno, "bsdfb: Failed to watch socket %d for %s",
+                      fd, notifierTypeName[type]);
+    }
+}
+
+void QBsdFbEventDispatcher::unregisterSocketNotifier(QSocketNotifier *notifier)
+{
+    Q_ASSERT(notifier);
+    const int fd = notifier->socket();
+    const int type = notifier->type();
+
+    auto it = m_notifiers.find(fd);
+    if (it == m_notifiers.end() || it->notifier[type] != notifier)
+        return;
+
+    const int oldMask = m_suspended.removeAll(fd) ? 0 : it->mask();
+    it->notifier[type] = nullptr;
+    const int newMask = it->mask();
+    if (!newMask)
+        m_notifiers.erase(it);
+    setInterest(fd, oldMask, newMask);
+}
+
+// Sockets ready while notifiers were excluded leave the kernel queue until
+// notifiers are processed again; being level triggered, they would
+// otherwise end every wait right away
+void QBsdFbEventDispatcher::suspendSocketNotifiers(const Ready *ready, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const int fd = ready[i].fd;
+        if (m_suspended.contains(fd) || !m_notifiers.contains(fd))
+            continue;
+        setInterest(fd, m_notifiers.value(fd).mask(), 0);
+        m_suspended.append(fd);
+    }
+}
+
+void QBsdFbEventDispatcher::resumeSocketNotifiers()
+{
+    for (int fd : qAsConst(m_suspended)) {
+        auto it = m_notifiers.constFind(fd);
+        if (it != m_notifiers.constEnd())
+            setInterest(fd, 0, it->mask());
+    }
+    m_suspended.clear();
+}
+
+int QBsdFbEventDispatcher::waitForEvents(timespec *timeout, Ready *ready, bool *woken)
+{
+    int count = 0;
+    *woken = false;
+
+#ifdef QBSDFB_EVENTDISPATCHER_KQUEUE
+    struct kevent events[MaxEvents];
+    const int n = kevent(m_queue, nullptr, 0, events, MaxEvents, timeout);
+    if (n < 0) {
+        if (errno != EINTR)
+            qErrnoWarning(errno, "bsdfb: kevent() failed");
+        return 0;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        const struct kevent &event = events[i];
+        if (event.filter == EVFILT_USER) {
+            m_wakeUps.storeRelease(0);
+            *woken = true;
+            continue;
+        }
+
+        int mask = 0;
+        if (event.filter == EVFILT_READ)
+            mask = Read;
+        else if (event.filter == EVFILT_WRITE)
+            mask = Write;
+#if defined(EVFILT_EXCEPT) && defined(NOTE_OOB)
+        else if (event.filter == EVFILT_EXCEPT)
+            mask = Exception;
+#endif
+        if (mask)
+            ready[count++] = { int(event.ident), mask };
+    }
+#else
+    // epoll_wait() only takes milliseconds, precise timers need a timerfd
+    int msecs = -1;
+    if (timeout && !timeout->tv_sec && !timeout->tv_nsec) {
+        msecs = 0;
+    } else if (timeout) {
+        itimerspec spec = {};
+        spec.it_value = *timeout;
+        timerfd_settime(m_timerFd, 0, &spec, nullptr);
+        m_timerArmed = true;
+    } else if (m_timerArmed) {
+        const itimerspec spec = {};
+        timerfd_settime(m_timerFd, 0, &spec, nullptr);
+        m_timerArmed = false;
+    }
+
+    epoll_event events[MaxEvents];
+    const int n = epoll_wait(m_queue, events, MaxEvents, msecs);
+    if (n < 0) {
+        if (errno != EINTR)
+            qErrnoWarning(errno, "bsdfb: epoll_wait() failed");
+        return 0;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        const epoll_event &event = events[i];
+        if (event.data.fd == m_wakeFd) {
+            eventfd_t value;
+            eventfd_read(m_wakeFd, &value);
+            m_wakeUps.storeRelease(0);
+            *woken = true;
+            continue;
+        }
+        if (event.data.fd == m_timerFd) {
+            uint64_t expirations;
+            ssize_t ret = ::read(m_timerFd, &expirations, sizeof(expirations));
+            Q_UNUSED(ret);
+            m_timerArmed = false;
+            continue;
+        }
+
+        // Hangups and errors wake up readers and writers, as with poll()
+        int mask = 0;
+        if (event.events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            mask |= Read;
+        if (event.events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+            mask |= Write;
+        if (event.events & EPOLLPRI)
+            mask |= Exception;
+        ready[count++] = { event.data.fd, mask };
+    }
+#endif
+
+    return count;
+}
+
+int QBsdFbEventDispatcher::activateSocketNotifiers(const Ready *ready, int count)
+{
+    int activated = 0;
+    QEvent event(QEvent::SockAct);
+
+    for (int i = 0; i < count; ++i) {
+        for (int type = 0; type < 3; ++type) {
+            if (!(ready[i].mask & (1 << type)))
+                continue;
+
+            // An earlier notifier may have removed this one
+            auto it = m_notifiers.constFind(ready[i].fd);
+            if (it == m_notifiers.constEnd())
+                break;
+            if (QSocketNotifier *notifier = it->notifier[type]) {
+                QCoreApplication::sendEvent(notifier, &event);
+                ++activated;
+            }
+        }
+    }
+
+    return activated;
+}
+
+bool QBsdFbEventDispatcher::processEvents(QEventLoop::ProcessEventsFlags flags)
+{
+    QThreadData *threadData = QObjectPrivate::get(this)->threadData;
+    m_interrupt.store(0);
+
+    emit awake();
+    QCoreApplicationPrivate::sendPostedEvents(nullptr, 0, threadData);
+
+    const bool includeTimers = !(flags & QEventLoop::X11ExcludeTimers);
+    const bool includeNotifiers = !(flags & QEventLoop::ExcludeSocketNotifiers);
+    const bool canWait = (flags & QEventLoop::WaitForMoreEvents)
+            && threadData->canWaitLocked() && !m_interrupt.load();
+
+    if (canWait)
+        emit aboutToBlock();
+
+    if (m_interrupt.load())
+        return false;
+
+    if (includeNotifiers && !m_suspended.isEmpty())
+        resumeSocketNotifiers();
+
+    timespec timeout = { 0, 0 };
+    timespec *wait = nullptr;
+    if (!canWait || (includeTimers && m_timers.timerWait(timeout)))
+        wait = &timeout;
+
+    // On the stack, notifiers may start nested event loops
+    Ready ready[MaxEvents];
+    bool woken;
+    const int count = waitForEvents(wait, ready, &woken);
+
+    int activated = woken ? 1 : 0;
+    if (includeNotifiers)
+        activated += activateSocketNotifiers(ready, count);
+    else
+        suspendSocketNotifiers(ready, count);
+
+    if (includeTimers)
+        activated += m_timers.activateTimers();
+
+    return activated > 0;
+}
+
+bool QBsdFbEventDispatcher::hasPendingEvents()
+{
+    return qGlobalPostedEventsCount();
+}
+
+void QBsdFbEventDispatcher::registerTimer(int timerId, int interval, Qt::TimerType timerType, QObject *object)
+{
+    m_timers.registerTimer(timerId, interval, timerType, object);
+}
+
+bool QBsdFbEventDispatcher::unregisterTimer(int timerId)
+{
+    return m_timers.unregisterTimer(timerId);
+}
+
+bool QBsdFbEventDispatcher::unregisterTimers(QObject *object)
+{
+    return m_timers.unregisterTimers(object);
+}
+
+QList<QAbstractEventDispatcher::TimerInfo> QBsdFbEventDispatcher::registeredTimers(QObject *object) const
+{
+    return m_timers.registeredTimers(object);
+}
+
+int QBsdFbEventDispatcher::remainingTime(int timerId)
+{
+    return m_timers.timerRemainingTime(timerId);
+}
+
+// May be called from any thread
+void QBsdFbEventDispatcher::wakeUp()
+{
+    if (!m_wakeUps.testAndSetAcquire(0, 1))
+        return;
+
+#ifdef QBSDFB_EVENTDISPATCHER_KQUEUE
+    struct kevent change;
+    EV_SET(&change, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
+    kevent(m_queue, &change, 1, nullptr, 0, nullptr);
+#else
+    eventfd_write(m_wakeFd, 1);
+#endif
+}
+
+void QBsdFbEventDispatcher::interrupt()
+{
+    m_interrupt.store(1);
+    wakeUp();
+}
+
+void QBsdFbEventDispatcher::flush()
+{
+}
+
+QBsdFbGuiEventDispatcher::QBsdFbGuiEventDispatcher(QObject *parent)
+    : QBsdFbEventDispatcher(parent)
+{
+}
+
+bool QBsdFbGuiEventDispatcher::processEvents(QEventLoop::ProcessEventsFlags flags)
+{
+    const bool didSendEvents = QBsdFbEventDispatcher::processEvents(flags);
+    return QWindowSystemInterface::sendWindowSystemEvents(flags) || didSendEvents;
+}
+
+bool QBsdFbGuiEventDispatcher::hasPendingEvents()
+{
+    return QBsdFbEventDispatcher::hasPendingEvents() || QWindowSystemInterface::windowSystemEventsQueued();
+}
+
+void QBsdFbGuiEventDispatcher::flush()
+{
+    if (qApp)
+        qApp->sendPostedEvents();
+}
+
+QT_END_NAMESPACE
+
+#endif
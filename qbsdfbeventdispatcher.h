@@ -0,0 +1,141 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBEVENTDISPATCHER_H
+#define QBSDFBEVENTDISPATCHER_H
+
+#include <QtCore/QAbstractEventDispatcher>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+#include <QtCore/private/qtimerinfo_unix_p.h>
+
+#if defined(Q_OS_FREEBSD)
+#define QBSDFB_EVENTDISPATCHER_KQUEUE
+#elif defined(Q_OS_LINUX)
+#define QBSDFB_EVENTDISPATCHER_EPOLL
+#endif
+
+#if defined(QBSDFB_EVENTDISPATCHER_KQUEUE) || defined(QBSDFB_EVENTDISPATCHER_EPOLL)
+
+QT_BEGIN_NAMESPACE
+
+// Event dispatcher on a kernel event queue: kqueue on FreeBSD and epoll on
+// Linux. Socket notifiers stay registered with the kernel between
+// iterations, so waiting costs the same for a handful of sockets as for
+// thousands, where the generic dispatcher rebuilds its poll set every
+// time. Timers are kept in a QTimerInfoList like in the generic
+// dispatcher; the wait for the next one is left to the kernel, through
+// kevent()'s timeout or a timerfd. Selected with
+// QT_QPA_BSDFB_EVENTDISPATCHER=kqueue or epoll.
+class QBsdFbEventDispatcher : public QAbstractEventDispatcher
+{
+public:
+    explicit QBsdFbEventDispatcher(QObject *parent = nullptr);
+    ~QBsdFbEventDispatcher() override;
+
+    static const char *backendName();
+
+    bool isValid() const { return m_queue >= 0; }
+
+    bool processEvents(QEventLoop::ProcessEventsFlags flags) override;
+    bool hasPendingEvents() override;
+
+    void registerSocketNotifier(QSocketNotifier *notifier) override;
+    void unregisterSocketNotifier(QSocketNotifier *notifier) override;
+
+    void registerTimer(int timerId, int interval, Qt::TimerType timerType, QObject *object) override;
+    bool unregisterTimer(int timerId) override;
+    bool unregisterTimers(QObject *object) override;
+    QList<TimerInfo> registeredTimers(QObject *object) const override;
+    int remainingTime(int timerId) override;
+
+    void wakeUp() override;
+    void interrupt() override;
+    void flush() override;
+
+private:
+    enum {
+        Read = 1,
+        Write = 2,
+        Exception = 4,
+        MaxEvents = 256
+    };
+
+    struct Notifiers {
+        QSocketNotifier *notifier[3] = { nullptr, nullptr, nullptr };
+        int mask() const;
+    };
+
+    struct Ready {
+        int fd;
+        int mask;
+    };
+
+    bool setInterest(int fd, int oldMask, int newMask);
+    int waitForEvents(timespec *timeout, Ready *ready, bool *woken);
+    int activateSocketNotifiers(const Ready *ready, int count);
+    void suspendSocketNotifiers(const Ready *ready, int count);
+    void resumeSocketNotifiers();
+
+    int m_queue = -1;
+#ifdef QBSDFB_EVENTDISPATCHER_EPOLL
+    int m_wakeFd = -1;
+    int m_timerFd = -1;
+    bool m_timerArmed = false;
+#endif
+    QHash<int, Notifiers> m_notifiers;
+    // Ready sockets seen while notifiers were excluded, they are level
+    // triggered and would keep the wait from blocking
+    QVector<int> m_suspended;
+    QTimerInfoList m_timers;
+    QAtomicInt m_wakeUps;
+    QAtomicInt m_interrupt;
+};
+
+// Also delivers the window system events, like the generic QPA dispatcher
+class QBsdFbGuiEventDispatcher : public QBsdFbEventDispatcher
+{
+public:
+    explicit QBsdFbGuiEventDispatcher(QObject *parent = nullptr);
+
+    bool processEvents(QEventLoop::ProcessEventsFlags flags) override;
+    bool hasPendingEvents() override;
+    void flush() override;
+};
+
+QT_END_NAMESPACE
+
+#endif
+
+#endif // QBSDFBEVENTDISPATCHER_H
@@ -0,0 +1,481 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbfontdatabase.h"
+#include "qbsdfbstartup.h"
+
+#ifdef Q_FONTCONFIGDATABASE
+
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QRunnable>
+#include <QtCore/QSaveFile>
+#include <QtGui/QFont>
+#include <QtGui/QFontDatabase>
+
+#include <fontconfig/fontconfig.h>
+#include <algorithm>
+#include <sys/stat.h>
+
+#ifndef FC_WEIGHT_EXTRABLACK
+#define FC_WEIGHT_EXTRABLACK 215
+#endif
+#endif // Q_FONTCONFIGDATABASE
+
+QT_BEGIN_NAMESPACE
+
+#ifdef Q_FONTCONFIGDATABASE
+
+namespace {
+
+enum {
+    SnapshotMagic = 0x51424653, // "QBFS"
+    SnapshotVersion = 1
+};
+
+Q_STATIC_ASSERT(QFontDatabase::WritingSystemsCount <= 64);
+
+struct FontEntry {
+    QString family;
+    QString style;
+    QString foundry;
+    QStringList aliases;
+    QString fileName;
+    qint32 index;
+    qint32 weight;
+    qint32 slant;
+    qint32 stretch;
+    qint32 pixelSize;
+    bool antialiased;
+    bool scalable;
+    bool fixedPitch;
+    quint64 writingSystems;
+};
+
+// A font directory or configuration file and its modification time
+struct Stamp {
+    QString path;
+    qint64 mtime;
+};
+
+struct Snapshot {
+    QVector<Stamp> stamps;
+    QVector<FontEntry> fonts;
+};
+
+QDataStream &operator<<(QDataStream &s, const FontEntry &e)
+{
+    return s << e.family << e.style << e.foundry << e.aliases << e.fileName << e.index
+             << e.weight << e.slant << e.stretch << e.pixelSize
+             << e.antialiased << e.scalable << e.fixedPitch << e.writingSystems;
+}
+
+QDataStream &operator>>(QDataStream &s, FontEntry &e)
+{
+    return s >> e.family >> e.style >> e.foundry >> e.aliases >> e.fileName >> e.index
+             >> e.weight >> e.slant >> e.stretch >> e.pixelSize
+             >> e.antialiased >> e.scalable >> e.fixedPitch >> e.writingSystems;
+}
+
+QDataStream &operator<<(QDataStream &s, const Stamp &stamp)
+{
+    return s << stamp.path << stamp.mtime;
+}
+
+QDataStream &operator>>(QDataStream &s, Stamp &stamp)
+{
+    return s >> stamp.path >> stamp.mtime;
+}
+
+} // namespace
+
+static qint64 modificationTime(const QByteArray &path)
+{
+    struct stat st;
+    if (::stat(path.constData(), &st))
+        return -1;
+    return qint64(st.st_mtime);
+}
+
+// Same languages QFontconfigDatabase uses to detect writing systems
+static const char languageForWritingSystem[][6] = {
+    "",     // Any
+    "en",   // Latin
+    "el",   // Greek
+    "ru",   // Cyrillic
+    "hy",   // Armenian
+    "he",   // Hebrew
+    "ar",   // Arabic
+    "syr",  // Syriac
+    "div",  // Thaana
+    "hi",   // Devanagari
+    "bn",   // Bengali
+    "pa",   // Gurmukhi
+    "gu",   // Gujarati
+    "or",   // Oriya
+    "ta",   // Tamil
+    "te",   // Telugu
+    "kn",   // Kannada
+    "ml",   // Malayalam
+    "si",   // Sinhala
+    "th",   // Thai
+    "lo",   // Lao
+    "bo",   // Tibetan
+    "my",   // Myanmar
+    "ka",   // Georgian
+    "km",   // Khmer
+    "zh-cn", // SimplifiedChinese
+    "zh-tw", // TraditionalChinese
+    "ja",   // Japanese
+    "ko",   // Korean
+    "vi",   // Vietnamese
+    "",     // Symbol
+    "sga",  // Ogham
+    "",     // Runic
+    ""      // N'Ko
+};
+Q_STATIC_ASSERT(sizeof(languageForWritingSystem) / sizeof(*languageForWritingSystem) == QFontDatabase::WritingSystemsCount);
+
+static int mapToQtWeightForRange(int fcweight, int fcLower, int fcUpper, int qtLower, int qtUpper)
+{
+    return qtLower + ((fcweight - fcLower) * (qtUpper - qtLower)) / (fcUpper - fcLower);
+}
+
+// Piecewise linear like QFontconfigDatabase, so that the named weights
+// map onto each other
+static int weightFromFcWeight(int fcweight)
+{
+    if (fcweight < 0)
+        return 0;
+    if (fcweight <= FC_WEIGHT_LIGHT)
+        return mapToQtWeightForRange(fcweight, 0, FC_WEIGHT_LIGHT, 0, QFont::Light);
+    if (fcweight <= FC_WEIGHT_NORMAL)
+        return mapToQtWeightForRange(fcweight, FC_WEIGHT_LIGHT, FC_WEIGHT_NORMAL, QFont::Light, QFont::Normal);
+    if (fcweight <= FC_WEIGHT_DEMIBOLD)
+        return mapToQtWeightForRange(fcweight, FC_WEIGHT_NORMAL, FC_WEIGHT_DEMIBOLD, QFont::Normal, QFont::DemiBold);
+    if (fcweight <= FC_WEIGHT_BOLD)
+        return mapToQtWeightForRange(fcweight, FC_WEIGHT_DEMIBOLD, FC_WEIGHT_BOLD, QFont::DemiBold, QFont::Bold);
+    if (fcweight <= FC_WEIGHT_BLACK)
+        return mapToQtWeightForRange(fcweight, FC_WEIGHT_BOLD, FC_WEIGHT_BLACK, QFont::Bold, QFont::Black);
+    if (fcweight <= FC_WEIGHT_EXTRABLACK)
+        return mapToQtWeightForRange(fcweight, FC_WEIGHT_BLACK, FC_WEIGHT_EXTRABLACK, QFont::Black, 99);
+    return 99;
+}
+
+static void addStamps(FcStrList *list, QVector<Stamp> *stamps)
+{
+    if (!list)
+        return;
+    while (const FcChar8 *path = FcStrListNext(list)) {
+        const QByteArray encoded(reinterpret_cast<const char *>(path));
+        stamps->append({ QFile::decodeName(encoded), modificationTime(encoded) });
+    }
+    FcStrListDone(list);
+}
+
+static FontEntry entryFromPattern(FcPattern *pattern)
+{
+    FontEntry entry;
+    FcChar8 *value = nullptr;
+
+    if (FcPatternGetString(pattern, FC_FAMILY, 0, &value) == FcResultMatch)
+        entry.family = QString::fromUtf8(reinterpret_cast<const char *>(value));
+    if (FcPatternGetString(pattern, FC_STYLE, 0, &value) == FcResultMatch)
+        entry.style = QString::fromUtf8(reinterpret_cast<const char *>(value));
+    if (FcPatternGetString(pattern, FC_FOUNDRY, 0, &value) == FcResultMatch)
+        entry.foundry = QString::fromLatin1(reinterpret_cast<const char *>(value));
+    if (FcPatternGetString(pattern, FC_FILE, 0, &value) == FcResultMatch)
+        entry.fileName = QFile::decodeName(reinterpret_cast<const char *>(value));
+    for (int i = 1; FcPatternGetString(pattern, FC_FAMILY, i, &value) == FcResultMatch; ++i)
+        entry.aliases.append(QString::fromUtf8(reinterpret_cast<const char *>(value)));
+
+    int index = 0, weight = FC_WEIGHT_REGULAR, slant = FC_SLANT_ROMAN;
+    int width = FC_WIDTH_NORMAL, spacing = FC_PROPORTIONAL;
+    FcPatternGetInteger(pattern, FC_INDEX, 0, &index);
+    FcPatternGetInteger(pattern, FC_WEIGHT, 0, &weight);
+    FcPatternGetInteger(pattern, FC_SLANT, 0, &slant);
+    FcPatternGetInteger(pattern, FC_WIDTH, 0, &width);
+    FcPatternGetInteger(pattern, FC_SPACING, 0, &spacing);
+
+    FcBool scalable = FcTrue, antialiased = FcTrue;
+    FcPatternGetBool(pattern, FC_SCALABLE, 0, &scalable);
+    FcPatternGetBool(pattern, FC_ANTIALIAS, 0, &antialiased);
+
+    double pixelSize = 0;
+    if (!scalable)
+        FcPatternGetDouble(pattern, FC_PIXEL_SIZE, 0, &pixelSize);
+
+    entry.index = index;
+    entry.weight = weightFromFcWeight(weight);
+    entry.slant = slant == FC_SLANT_ITALIC ? QFont::StyleItalic
+                : slant == FC_SLANT_OBLIQUE ? QFont::StyleOblique : QFont::StyleNormal;
+    entry.stretch = width;
+    entry.pixelSize = qRound(pixelSize);
+    entry.antialiased = antialiased;
+    entry.scalable = scalable;
+    entry.fixedPitch = spacing >= FC_MONO;
+
+    // Symbol fonts have no languages and are kept apart from the others
+    entry.writingSystems = 0;
+    FcLangSet *langSet = nullptr;
+    if (FcPatternGetLangSet(pattern, FC_LANG, 0, &langSet) == FcResultMatch) {
+        for (int i = 1; i < QFontDatabase::WritingSystemsCount; ++i) {
+            const FcChar8 *lang = reinterpret_cast<const FcChar8 *>(languageForWritingSystem[i]);
+            if (*lang && FcLangSetHasLang(langSet, lang) != FcLangDifferentLang)
+                entry.writingSystems |= Q_UINT64_C(1) << i;
+        }
+    }
+    if (!entry.writingSystems)
+        entry.writingSystems = Q_UINT64_C(1) << QFontDatabase::Other;
+
+    return entry;
+}
+
+// Runs on a worker thread with its own fontconfig configuration. The
+// configured directories are scanned one at a time, so that cancelling
+// does not have to wait for a rescan of every font. Returns an empty
+// snapshot when cancelled.
+static Snapshot scanFonts(const QAtomicInt &cancelled)
+{
+    Snapshot snapshot;
+
+    FcConfig *config = FcInitLoadConfig();
+    if (!config)
+        return snapshot;
+
+    if (FcStrList *dirs = FcConfigGetConfigDirs(config)) {
+        while (const FcChar8 *dir = FcStrListNext(dirs)) {
+            if (cancelled.loadAcquire())
+                break;
+            FcConfigAppFontAddDir(config, dir);
+        }
+        FcStrListDone(dirs);
+    }
+    if (cancelled.loadAcquire()) {
+        FcConfigDestroy(config);
+        return snapshot;
+    }
+
+    // Includes the subdirectories found while scanning
+    addStamps(FcConfigGetFontDirs(config), &snapshot.stamps);
+    addStamps(FcConfigGetConfigFiles(config), &snapshot.stamps);
+
+    FcPattern *pattern = FcPatternCreate();
+    FcObjectSet *objects = FcObjectSetBuild(FC_FAMILY, FC_STYLE, FC_FOUNDRY, FC_FILE, FC_INDEX,
+                                            FC_WEIGHT, FC_SLANT, FC_WIDTH, FC_SPACING,
+                                            FC_SCALABLE, FC_ANTIALIAS, FC_PIXEL_SIZE, FC_LANG,
+                                            (const char *)nullptr);
+    FcFontSet *fonts = FcFontList(config, pattern, objects);
+    FcObjectSetDestroy(objects);
+    FcPatternDestroy(pattern);
+
+    if (fonts) {
+        snapshot.fonts.reserve(fonts->nfont);
+        for (int i = 0; i < fonts->nfont && !cancelled.loadAcquire(); ++i) {
+            const FontEntry entry = entryFromPattern(fonts->fonts[i]);
+            if (!entry.family.isEmpty() && !entry.fileName.isEmpty())
+                snapshot.fonts.append(entry);
+        }
+        FcFontSetDestroy(fonts);
+    }
+
+    FcConfigDestroy(config);
+    if (cancelled.loadAcquire())
+        snapshot.fonts.clear();
+    return snapshot;
+}
+
+static bool readSnapshot(const QString &fileName, Snapshot *snapshot)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_6);
+    quint32 magic = 0, version = 0;
+    in >> magic >> version;
+    if (magic != SnapshotMagic || version != SnapshotVersion)
+        return false;
+
+    in >> snapshot->stamps >> snapshot->fonts;
+    return in.status() == QDataStream::Ok && !snapshot->fonts.isEmpty();
+}
+
+static bool writeSnapshot(const QString &fileName, const Snapshot &snapshot)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << quint32(SnapshotMagic) << quint32(SnapshotVersion) << snapshot.stamps << snapshot.fonts;
+    return out.status() == QDataStream::Ok && file.commit();
+}
+
+static bool isCurrent(const Snapshot &snapshot)
+{
+    for (const Stamp &stamp : snapshot.stamps) {
+        if (modificationTime(QFile::encodeName(stamp.path)) != stamp.mtime)
+            return false;
+    }
+    return true;
+}
+
+namespace {
+class SnapshotWriter : public QRunnable
+{
+public:
+    SnapshotWriter(const QString &fileName, const QAtomicInt &cancelled)
+        : m_fileName(fileName), m_cancelled(cancelled) {}
+
+    void run() override
+    {
+        QBsdFbStartupPhase phase("font snapshot");
+        const Snapshot snapshot = scanFonts(m_cancelled);
+        if (m_cancelled.loadAcquire())
+            return;
+        if (snapshot.fonts.isEmpty() || !writeSnapshot(m_fileName, snapshot))
+            qWarning("bsdfb: Failed to write font snapshot %s", qPrintable(m_fileName));
+    }
+
+private:
+    QString m_fileName;
+    const QAtomicInt &m_cancelled;
+};
+}
+
+// Fonts removed since a stale snapshot was written would fail to open
+static void dropMissingFonts(Snapshot *snapshot)
+{
+    QHash<QString, bool> exists;
+    QVector<FontEntry> &fonts = snapshot->fonts;
+    auto missing = [&exists](const FontEntry &entry) {
+        auto it = exists.find(entry.fileName);
+        if (it == exists.end())
+            it = exists.insert(entry.fileName, QFile::exists(entry.fileName));
+        return !it.value();
+    };
+    fonts.erase(std::remove_if(fonts.begin(), fonts.end(), missing), fonts.end());
+}
+
+#endif // Q_FONTCONFIGDATABASE
+
+QBsdFbFontDatabase::QBsdFbFontDatabase(const QString &snapshotFile)
+    : m_snapshotFile(snapshotFile)
+{
+#ifdef Q_FONTCONFIGDATABASE
+    m_writer.setMaxThreadCount(1);
+#endif
+}
+
+// A short-lived application does not wait for a full rescan; the writer
+// stops after the directory it is scanning and writes nothing
+QBsdFbFontDatabase::~QBsdFbFontDatabase()
+{
+#ifdef Q_FONTCONFIGDATABASE
+    m_cancelled.storeRelease(1);
+    m_writer.clear();
+    m_writer.waitForDone();
+#endif
+}
+
+void QBsdFbFontDatabase::populateFontDatabase()
+{
+    QBsdFbStartupPhase phase("fonts");
+
+#ifdef Q_FONTCONFIGDATABASE
+    if (m_snapshotFile.isEmpty()) {
+        QGenericUnixFontDatabase::populateFontDatabase();
+        return;
+    }
+
+    Snapshot snapshot;
+    if (!readSnapshot(m_snapshotFile, &snapshot)) {
+        QGenericUnixFontDatabase::populateFontDatabase();
+        m_writer.start(new SnapshotWriter(m_snapshotFile, m_cancelled));
+        return;
+    }
+
+    if (!isCurrent(snapshot)) {
+        dropMissingFonts(&snapshot);
+        m_writer.start(new SnapshotWriter(m_snapshotFile, m_cancelled));
+    }
+
+    for (const FontEntry &entry : qAsConst(snapshot.fonts)) {
+        QSupportedWritingSystems writingSystems;
+        for (int i = 0; i < QFontDatabase::WritingSystemsCount; ++i) {
+            if (entry.writingSystems & (Q_UINT64_C(1) << i))
+                writingSystems.setSupported(QFontDatabase::WritingSystem(i));
+        }
+
+        // Released by QFontconfigDatabase
+        FontFile *fontFile = new FontFile;
+        fontFile->fileName = entry.fileName;
+        fontFile->indexValue = entry.index;
+
+        registerFont(entry.family, entry.style, entry.foundry, QFont::Weight(entry.weight),
+                     QFont::Style(entry.slant), QFont::Stretch(entry.stretch),
+                     entry.antialiased, entry.scalable, entry.pixelSize, entry.fixedPitch,
+                     writingSystems, fontFile);
+        for (const QString &alias : entry.aliases)
+            registerAliasToFontFamily(entry.family, alias);
+    }
+
+    // The generic families QFontconfigDatabase registers after scanning
+    static const struct {
+        const char *family;
+        bool fixedPitch;
+    } defaults[] = {
+        { "Serif", false },
+        { "Sans Serif", false },
+        { "Monospace", true }
+    };
+    QSupportedWritingSystems latin;
+    latin.setSupported(QFontDatabase::Latin);
+    for (const auto &f : defaults) {
+        const QString family = QString::fromLatin1(f.family);
+        for (QFont::Style style : { QFont::StyleNormal, QFont::StyleItalic, QFont::StyleOblique }) {
+            registerFont(family, QString(), QString(), QFont::Normal, style, QFont::Unstretched,
+                         true, true, 0, f.fixedPitch, latin, nullptr);
+        }
+    }
+#else
+    QGenericUnixFontDatabase::populateFontDatabase();
+#endif
+}
+
+QT_END_NAMESPACE
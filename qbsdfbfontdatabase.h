@@ -0,0 +1,74 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBFONTDATABASE_H
+#define QBSDFBFONTDATABASE_H
+
+#include <QtPlatformSupport/private/qgenericunixfontdatabase_p.h>
+
+#ifdef Q_FONTCONFIGDATABASE
+#include <QtCore/QAtomicInt>
+#include <QtCore/QThreadPool>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+// With fontconfig and a snapshot file, populates the font database from a
+// snapshot of a previous scan instead of scanning on every start. The
+// snapshot records the modification times of the font directories and
+// fontconfig configuration files; when one of them changed the stale
+// snapshot is still used for this run, minus fonts whose files are gone,
+// and a fresh one is written in the background for the next. Without a
+// snapshot the fonts are scanned as usual and one is written afterwards.
+// Otherwise this is the generic database, timed as a startup phase.
+class QBsdFbFontDatabase : public QGenericUnixFontDatabase
+{
+public:
+    explicit QBsdFbFontDatabase(const QString &snapshotFile);
+    ~QBsdFbFontDatabase() override;
+
+    void populateFontDatabase() override;
+
+private:
+    QString m_snapshotFile;
+#ifdef Q_FONTCONFIGDATABASE
+    // Set on destruction so that a running snapshot writer gives up
+    QAtomicInt m_cancelled;
+    QThreadPool m_writer;
+#endif
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBFONTDATABASE_H
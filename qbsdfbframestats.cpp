@@ -0,0 +1,105 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbframestats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+QBsdFbFrameStats::QBsdFbFrameStats(int dumpInterval)
+    : m_dumpInterval(qint64(dumpInterval) * 1000000000LL)
+{
+    memset(&m_ring, 0, sizeof(m_ring));
+    m_clock.start();
+}
+
+// May be called from any thread
+void QBsdFbFrameStats::addBlit(qint64 time, int rects, qint64 pixels)
+{
+    m_blitTime.fetchAndAddRelaxed(time);
+    m_rects.fetchAndAddRelaxed(rects);
+    m_pixels.fetchAndAddRelaxed(pixels);
+}
+
+// When presenting synchronously the framebuffer writes happened within
+// start and end and are not part of the composition time
+void QBsdFbFrameStats::recordFrame(qint64 start, qint64 end, bool synchronous)
+{
+    Frame &frame = m_ring.frames[m_ring.count % Capacity];
+    frame.timestamp = end;
+    frame.blitTime = m_blitTime.fetchAndStoreRelaxed(0);
+    frame.composeTime = end - start - (synchronous ? frame.blitTime : 0);
+    frame.pixels = m_pixels.fetchAndStoreRelaxed(0);
+    frame.rects = m_rects.fetchAndStoreRelaxed(0);
+    frame.skipped = m_skipped.fetchAndStoreRelaxed(0);
+    ++m_ring.count;
+
+    if (m_dumpInterval > 0 && end - m_lastDump >= m_dumpInterval)
+        dump(end);
+}
+
+void QBsdFbFrameStats::dump(qint64 end)
+{
+    const quint64 frames = qMin<quint64>(m_ring.count - m_lastDumpCount, Capacity);
+    if (frames == 0)
+        return;
+
+    qint64 composeTotal = 0, composeMax = 0, blitTotal = 0, blitMax = 0, pixels = 0;
+    qint64 rects = 0, skipped = 0;
+    for (quint64 i = m_ring.count - frames; i < m_ring.count; ++i) {
+        const Frame &frame = m_ring.frames[i % Capacity];
+        composeTotal += frame.composeTime;
+        composeMax = qMax(composeMax, frame.composeTime);
+        blitTotal += frame.blitTime;
+        blitMax = qMax(blitMax, frame.blitTime);
+        pixels += frame.pixels;
+        rects += frame.rects;
+        skipped += frame.skipped;
+    }
+
+    const double seconds = (end - m_lastDump) / 1e9;
+    fprintf(stderr, "bsdfb: %.1f fps, compose avg %.2f max %.2f ms, blit avg %.2f max %.2f ms, "
+                    "%lld rects, %.1f Mpixels/s, %lld frames skipped\n",
+            (m_ring.count - m_lastDumpCount) / seconds,
+            composeTotal / 1e6 / frames, composeMax / 1e6,
+            blitTotal / 1e6 / frames, blitMax / 1e6,
+            rects, pixels / 1e6 / seconds, skipped);
+
+    m_lastDump = end;
+    m_lastDumpCount = m_ring.count;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBFRAMESTATS_H
+#define QBSDFBFRAMESTATS_H
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QElapsedTimer>
+
+QT_BEGIN_NAMESPACE
+
+// Per-frame statistics kept in a ring buffer. Framebuffer writes may happen
+// on the presenter thread and are accumulated atomically until the GUI
+// thread records the next frame.
+class QBsdFbFrameStats
+{
+public:
+    enum {
+        Capacity = 256
+    };
+
+    // All times are in nanoseconds. composeTime covers everything done on
+    // the GUI thread for a frame except writing to the framebuffer.
+    struct Frame {
+        qint64 timestamp;
+        qint64 composeTime;
+        qint64 blitTime;
+        qint64 pixels;
+        qint32 rects;
+        qint32 skipped;
+    };
+
+    // Layout of the "framestats" screen resource. The newest frame is
+    // frames[(count - 1) % Capacity].
+    struct Ring {
+        quint64 count;
+        Frame frames[Capacity];
+    };
+
+    explicit QBsdFbFrameStats(int dumpInterval);
+
+    qint64 now() const { return m_clock.nsecsElapsed(); }
+
+    void addBlit(qint64 time, int rects, qint64 pixels);
+    void addSkipped(int frames) { m_skipped.fetchAndAddRelaxed(frames); }
+
+    void recordFrame(qint64 start, qint64 end, bool synchronous);
+
+    const Ring *ring() const { return &m_ring; }
+
+private:
+    void dump(qint64 end);
+
+    QElapsedTimer m_clock;
+    Ring m_ring;
+
+    QAtomicInteger<qint64> m_blitTime;
+    QAtomicInteger<qint64> m_pixels;
+    QAtomicInt m_rects;
+    QAtomicInt m_skipped;
+
+    qint64 m_dumpInterval;
+    qint64 m_lastDump = 0;
+    quint64 m_lastDumpCount = 0;
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBFRAMESTATS_H
@@ -0,0 +1,451 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbinput.h"
+#include "qbsdfbscreen.h"
+
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QTimerEvent>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QScreen>
+#include <QtGui/private/qguiapplication_p.h>
+#include <QtGui/private/qinputdevicemanager_p.h>
+#include <qpa/qwindowsysteminterface.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#ifdef Q_OS_FREEBSD
+#include <sys/mouse.h>
+#endif
+
+#ifndef QT_NO_EVDEV
+#ifdef Q_OS_FREEBSD
+#include <dev/evdev/input.h>
+#else
+#include <linux/input.h>
+#endif
+#endif
+
+QT_BEGIN_NAMESPACE
+
+enum {
+    SysMousePacketSize = 8
+};
+
+QPoint QBsdFbPointerHandler::s_pos;
+bool QBsdFbPointerHandler::s_posValid = false;
+
+QBsdFbPointerHandler *QBsdFbPointerHandler::create(Protocol protocol, const QString &device)
+{
+    const int fd = ::open(QFile::encodeName(device).constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        qErrnoWarning(errno, "bsdfb: Failed to open input device %s", qPrintable(device));
+        return nullptr;
+    }
+
+#ifdef Q_OS_FREEBSD
+    // Level 1 adds the wheel and extra buttons to the MouseSystems packet
+    if (protocol == SysMouse) {
+        int level = 1;
+        if (::ioctl(fd, MOUSE_SETLEVEL, &level) < 0) {
+            qErrnoWarning(errno, "bsdfb: Failed to set %s to level 1", qPrintable(device));
+            ::close(fd);
+            return nullptr;
+        }
+    }
+#endif
+
+    return new QBsdFbPointerHandler(protocol, fd);
+}
+
+QBsdFbPointerHandler::QBsdFbPointerHandler(Protocol protocol, int fd)
+    : m_protocol(protocol),
+      m_fd(fd)
+{
+#ifndef QT_NO_EVDEV
+    if (protocol == Evdev && fd >= 0) {
+        input_absinfo info;
+        if (::ioctl(fd, EVIOCGABS(ABS_X), &info) >= 0) {
+            m_absMinX = info.minimum;
+            m_absMaxX = info.maximum;
+        }
+        if (::ioctl(fd, EVIOCGABS(ABS_Y), &info) >= 0) {
+            m_absMinY = info.minimum;
+            m_absMaxY = info.maximum;
+        }
+    }
+#endif
+
+    if (m_fd >= 0) {
+        m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+        connect(m_notifier, SIGNAL(activated(int)), this, SLOT(readDevice()));
+    }
+
+    QInputDeviceManager *manager = QGuiApplicationPrivate::inputDeviceManager();
+    connect(manager, SIGNAL(cursorPositionChangeRequested(QPoint)), this, SLOT(setPos(QPoint)));
+
+    // The first handler starts the pointer in the middle, moves are limited
+    // to the refresh rate
+    if (QScreen *screen = QGuiApplication::primaryScreen()) {
+        if (!s_posValid) {
+            s_pos = screen->virtualGeometry().center();
+            s_posValid = true;
+        }
+        m_moveInterval = qint64(1e9 / qMax(screen->refreshRate(), qreal(1)));
+    }
+    m_clock.start();
+}
+
+QBsdFbPointerHandler::~QBsdFbPointerHandler()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+int QBsdFbPointerHandler::recordSize() const
+{
+#ifndef QT_NO_EVDEV
+    if (m_protocol == Evdev)
+        return sizeof(input_event);
+#endif
+    return SysMousePacketSize;
+}
+
+void QBsdFbPointerHandler::readDevice()
+{
+    for (int reads = 0; reads < MaxReadsPerBatch; ++reads) {
+        const ssize_t n = ::read(m_fd, m_buffer + m_buffered, BufferSize - m_buffered);
+        if (n > 0) {
+            m_buffered += n;
+            parse();
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0) {
+            qWarning("bsdfb: Input device went away");
+            m_notifier->setEnabled(false);
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            qErrnoWarning(errno, "bsdfb: Could not read from input device");
+            m_notifier->setEnabled(false);
+        }
+        break;
+    }
+
+    flush();
+}
+
+void QBsdFbPointerHandler::feed(const uchar *data, int size)
+{
+    while (size > 0) {
+        const int n = qMin(size, int(BufferSize) - m_buffered);
+        memcpy(m_buffer + m_buffered, data, n);
+        m_buffered += n;
+        data += n;
+        size -= n;
+        parse();
+    }
+
+    flush();
+}
+
+// Handles all complete records and keeps the rest for the next read
+void QBsdFbPointerHandler::parse()
+{
+    const int size = recordSize();
+    int offset = 0;
+
+    if (m_protocol == SysMouse) {
+        while (m_buffered - offset >= size)
+            offset += parseSysMouse(m_buffer + offset);
+    } else {
+        for (; m_buffered - offset >= size; offset += size)
+            parseEvdev(m_buffer + offset);
+    }
+
+    m_buffered -= offset;
+    memmove(m_buffer, m_buffer + offset, m_buffered);
+}
+
+// Returns the number of bytes consumed, a single one while resynchronizing
+int QBsdFbPointerHandler::parseSysMouse(const uchar *packet)
+{
+    if ((packet[0] & 0xf8) != 0x80)
+        return 1;
+
+    // Buttons are active low; y and z grow upwards
+    Qt::MouseButtons buttons = Qt::NoButton;
+    if (!(packet[0] & 0x04))
+        buttons |= Qt::LeftButton;
+    if (!(packet[0] & 0x02))
+        buttons |= Qt::MiddleButton;
+    if (!(packet[0] & 0x01))
+        buttons |= Qt::RightButton;
+    if (!(packet[7] & 0x01))
+        buttons |= Qt::BackButton;
+    if (!(packet[7] & 0x02))
+        buttons |= Qt::ForwardButton;
+
+    const int dx = qint8(packet[1]) + qint8(packet[3]);
+    const int dy = qint8(packet[2]) + qint8(packet[4]);
+    // 7 bit two's complement
+    const int dz = (qint8(packet[5] << 1) >> 1) + (qint8(packet[6] << 1) >> 1);
+
+    if (dx || dy)
+        move(dx, -dy);
+    setButtons(buttons);
+    if (dz)
+        sendWheel(QPoint(0, -dz * 120));
+
+    return SysMousePacketSize;
+}
+
+void QBsdFbPointerHandler::parseEvdev(const uchar *data)
+{
+#ifndef QT_NO_EVDEV
+    input_event event;
+    memcpy(&event, data, sizeof(event));
+
+    if (event.type == EV_SYN) {
+        if (event.code == SYN_REPORT) {
+            if (!m_dropped)
+                endFrame();
+            m_dropped = false;
+        } else if (event.code == SYN_DROPPED) {
+            // The kernel queue overflowed, skip the incomplete frame
+            m_dropped = true;
+            m_relX = m_relY = 0;
+            m_wheel = QPoint();
+        }
+        return;
+    }
+
+    if (event.type == EV_REL) {
+        if (event.code == REL_X)
+            m_relX += event.value;
+        else if (event.code == REL_Y)
+            m_relY += event.value;
+        else if (event.code == REL_WHEEL)
+            m_wheel.ry() += event.value * 120;
+        else if (event.code == REL_HWHEEL)
+            m_wheel.rx() += event.value * 120;
+    } else if (event.type == EV_ABS) {
+        if (event.code == ABS_X || event.code == ABS_MT_POSITION_X)
+            m_absX = event.value;
+        else if (event.code == ABS_Y || event.code == ABS_MT_POSITION_Y)
+            m_absY = event.value;
+    } else if (event.type == EV_KEY) {
+        Qt::MouseButton button = Qt::NoButton;
+        switch (event.code) {
+        case BTN_LEFT:
+        case BTN_TOUCH:
+            button = Qt::LeftButton;
+            break;
+        case BTN_RIGHT:
+            button = Qt::RightButton;
+            break;
+        case BTN_MIDDLE:
+            button = Qt::MiddleButton;
+            break;
+        case BTN_SIDE:
+            button = Qt::BackButton;
+            break;
+        case BTN_EXTRA:
+            button = Qt::ForwardButton;
+            break;
+        default:
+            break;
+        }
+        if (event.value)
+            m_frameButtons |= button;
+        else
+            m_frameButtons &= ~button;
+    }
+#else
+    Q_UNUSED(data);
+#endif
+}
+
+void QBsdFbPointerHandler::endFrame()
+{
+    if (m_relX || m_relY) {
+        move(m_relX, m_relY);
+        m_relX = m_relY = 0;
+    }
+
+    if (m_absX >= 0 || m_absY >= 0) {
+        const QRect geometry = QGuiApplication::primaryScreen()
+                ? QGuiApplication::primaryScreen()->virtualGeometry() : QRect();
+        QPoint pos = s_pos;
+        // Without a range from the device the values are pixels
+        if (m_absX >= 0) {
+            pos.setX(m_absMaxX > m_absMinX
+                     ? geometry.left() + qint64(m_absX - m_absMinX) * (geometry.width() - 1) / (m_absMaxX - m_absMinX)
+                     : m_absX);
+        }
+        if (m_absY >= 0) {
+            pos.setY(m_absMaxY > m_absMinY
+                     ? geometry.top() + qint64(m_absY - m_absMinY) * (geometry.height() - 1) / (m_absMaxY - m_absMinY)
+                     : m_absY);
+        }
+        m_absX = m_absY = -1;
+        move(pos.x() - s_pos.x(), pos.y() - s_pos.y());
+    }
+
+    setButtons(m_frameButtons);
+
+    if (!m_wheel.isNull()) {
+        sendWheel(m_wheel);
+        m_wheel = QPoint();
+    }
+}
+
+void QBsdFbPointerHandler::move(int dx, int dy)
+{
+    ++m_samples;
+
+    QPoint pos = s_pos + QPoint(dx, dy);
+    if (QScreen *screen = QGuiApplication::primaryScreen()) {
+        const QRect geometry = screen->virtualGeometry();
+        pos.setX(qBound(geometry.left(), pos.x(), geometry.right()));
+        pos.setY(qBound(geometry.top(), pos.y(), geometry.bottom()));
+    }
+
+    if (pos != s_pos) {
+        s_pos = pos;
+        m_movePending = true;
+    }
+}
+
+void QBsdFbPointerHandler::setButtons(Qt::MouseButtons buttons)
+{
+    if (buttons == m_buttons)
+        return;
+
+    // The press or release happens where the pointer is now
+    sendMove();
+    m_buttons = buttons;
+    QWindowSystemInterface::handleMouseEvent(nullptr, s_pos, s_pos, m_buttons,
+                                             QGuiApplicationPrivate::inputDeviceManager()->keyboardModifiers());
+}
+
+void QBsdFbPointerHandler::sendWheel(const QPoint &delta)
+{
+    sendMove();
+    QWindowSystemInterface::handleWheelEvent(nullptr, s_pos, s_pos, QPoint(), delta,
+                                             QGuiApplicationPrivate::inputDeviceManager()->keyboardModifiers());
+}
+
+void QBsdFbPointerHandler::sendMove()
+{
+    m_moveTimer.stop();
+    if (!m_movePending)
+        return;
+
+    m_movePending = false;
+    m_lastMove = m_clock.nsecsElapsed();
+    ++m_moves;
+    QWindowSystemInterface::handleMouseEvent(nullptr, s_pos, s_pos, m_buttons,
+                                             QGuiApplicationPrivate::inputDeviceManager()->keyboardModifiers());
+}
+
+// Called after every batch; a move within a frame interval of the previous
+// one waits for the interval to pass and absorbs the batches until then
+void QBsdFbPointerHandler::flush()
+{
+    if (!m_movePending || m_moveTimer.isActive())
+        return;
+
+    const qint64 elapsed = m_clock.nsecsElapsed() - m_lastMove;
+    if (m_lastMove < 0 || elapsed >= m_moveInterval)
+        sendMove();
+    else
+        m_moveTimer.start(int((m_moveInterval - elapsed + 999999) / 1000000), Qt::PreciseTimer, this);
+}
+
+void QBsdFbPointerHandler::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_moveTimer.timerId()) {
+        sendMove();
+        return;
+    }
+
+    QObject::timerEvent(event);
+}
+
+// QCursor::setPos()
+void QBsdFbPointerHandler::setPos(const QPoint &pos)
+{
+    s_pos = pos;
+    s_posValid = true;
+}
+
+QBsdFbInputReplay::QBsdFbInputReplay(QBsdFbPointerHandler::Protocol protocol, const QString &fileName)
+    : m_handler(protocol),
+      m_file(fileName)
+{
+    m_chunkSize = m_handler.recordSize() * ReplayRecords;
+
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning("bsdfb: Failed to open input recording %s", qPrintable(fileName));
+        return;
+    }
+
+    m_timer.start(1, Qt::PreciseTimer, this);
+}
+
+void QBsdFbInputReplay::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != m_timer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    const QByteArray chunk = m_file.read(m_chunkSize);
+    if (!chunk.isEmpty()) {
+        m_handler.feed(reinterpret_cast<const uchar *>(chunk.constData()), chunk.size());
+        return;
+    }
+
+    m_timer.stop();
+    m_handler.flush();
+    qCDebug(qLcBsdFb, "Replayed %s: %d samples coalesced into %d moves",
+            qPrintable(m_file.fileName()), m_handler.samples(), m_handler.moves());
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,170 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBINPUT_H
+#define QBSDFBINPUT_H
+
+#include <QtCore/QBasicTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QObject>
+#include <QtCore/QPoint>
+
+QT_BEGIN_NAMESPACE
+
+class QSocketNotifier;
+
+// Pointer input from a sysmouse (level 1) or evdev device. The device is
+// drained with non-blocking reads whenever it becomes readable and the
+// motion samples of a batch are merged into a single move. Moves are
+// further limited to one per screen refresh, so a 1000 Hz mouse costs one
+// event and one cursor update per frame; button and wheel changes are
+// delivered at once, preceded by any pending move. Absolute evdev devices
+// such as single-touch screens act as a mouse with the left button.
+//
+// All handlers move one shared pointer, so several mice do not each keep
+// a position of their own. Keyboards are only read through evdev; a
+// console keyboard without evdev support, e.g. kbdmux over atkbd on a
+// stock FreeBSD kernel, provides no key events.
+class QBsdFbPointerHandler : public QObject
+{
+    Q_OBJECT
+public:
+    enum Protocol {
+        SysMouse,
+        Evdev
+    };
+
+    // Opens the device, nullptr if that fails
+    static QBsdFbPointerHandler *create(Protocol protocol, const QString &device);
+
+    // Without a device data must be passed to feed()
+    explicit QBsdFbPointerHandler(Protocol protocol, int fd = -1);
+    ~QBsdFbPointerHandler() override;
+
+    // Parses a batch of raw device data, followed by flush()
+    void feed(const uchar *data, int size);
+    void flush();
+
+    int recordSize() const;
+    int samples() const { return m_samples; }
+    int moves() const { return m_moves; }
+
+protected:
+    void timerEvent(QTimerEvent *event) override;
+
+private slots:
+    void readDevice();
+    void setPos(const QPoint &pos);
+
+private:
+    enum {
+        BufferSize = 4096,
+        MaxReadsPerBatch = 16
+    };
+
+    void parse();
+    int parseSysMouse(const uchar *data);
+    void parseEvdev(const uchar *data);
+    void endFrame();
+    void move(int dx, int dy);
+    void setButtons(Qt::MouseButtons buttons);
+    void sendMove();
+    void sendWheel(const QPoint &delta);
+
+    Protocol m_protocol;
+    int m_fd;
+    QSocketNotifier *m_notifier = nullptr;
+
+    uchar m_buffer[BufferSize];
+    int m_buffered = 0;
+
+    // Where the pointer is, moved by every handler
+    static QPoint s_pos;
+    static bool s_posValid;
+    Qt::MouseButtons m_buttons = Qt::NoButton;
+    int m_samples = 0;
+    int m_moves = 0;
+
+    // Moves are held back until a frame interval passed since the last
+    bool m_movePending = false;
+    qint64 m_lastMove = -1;
+    qint64 m_moveInterval = 0;
+    QElapsedTimer m_clock;
+    QBasicTimer m_moveTimer;
+
+    // State accumulated between evdev SYN_REPORTs
+    int m_relX = 0;
+    int m_relY = 0;
+    QPoint m_wheel;
+    int m_absX = -1;
+    int m_absY = -1;
+    int m_absMinX = 0;
+    int m_absMaxX = 0;
+    int m_absMinY = 0;
+    int m_absMaxY = 0;
+    Qt::MouseButtons m_frameButtons = Qt::NoButton;
+    bool m_dropped = false;
+};
+
+// Feeds a recording of raw device data, e.g. captured with cat from
+// /dev/sysmouse or an evdev node, to a pointer handler at a fixed rate of
+// ReplayRecords records per millisecond, and prints how many moves the
+// samples were coalesced into once the file is exhausted.
+class QBsdFbInputReplay : public QObject
+{
+public:
+    enum {
+        ReplayRecords = 8
+    };
+
+    QBsdFbInputReplay(QBsdFbPointerHandler::Protocol protocol, const QString &fileName);
+
+    bool isValid() const { return m_file.isOpen(); }
+    bool isFinished() const { return !m_timer.isActive(); }
+    const QBsdFbPointerHandler &handler() const { return m_handler; }
+
+protected:
+    void timerEvent(QTimerEvent *event) override;
+
+private:
+    QBsdFbPointerHandler m_handler;
+    QFile m_file;
+    QBasicTimer m_timer;
+    int m_chunkSize;
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBINPUT_H
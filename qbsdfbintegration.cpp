@@ -34,17 +34,27 @@
 
 #include "qbsdfbintegration.h"
 #include "qbsdfbscreen.h"
+#include "qbsdfbbackingstore.h"
+#include "qbsdfbtilecache.h"
+#include "qbsdfbframestats.h"
+#include "qbsdfbtracer.h"
+#include "qbsdfbstartup.h"
+#include "qbsdfbfontdatabase.h"
+#include "qbsdfbeventdispatcher.h"
+#include "qbsdfbinput.h"
 
 #include <QtPlatformSupport/private/qgenericunixfontdatabase_p.h>
 #include <QtPlatformSupport/private/qgenericunixservices_p.h>
 #include <QtPlatformSupport/private/qgenericunixeventdispatcher_p.h>
 
 #include <QtPlatformSupport/private/qfbvthandler_p.h>
-#include <QtPlatformSupport/private/qfbbackingstore_p.h>
 #include <QtPlatformSupport/private/qfbwindow_p.h>
 #include <QtPlatformSupport/private/qfbcursor_p.h>
 
+#include <QtCore/QFile>
 #include <QtGui/private/qguiapplication_p.h>
+#include <QtGui/private/qinputdevicemanager_p_p.h>
+#include <QtGui/QScreen>
 #include <qpa/qplatforminputcontext.h>
 #include <qpa/qplatforminputcontextfactory_p.h>
 
@@ -52,33 +62,98 @@
 #include <QtPlatformSupport/private/qtslib_p.h>
 #endif
 
+#if !defined(QT_NO_EVDEV)
+#include <QtPlatformSupport/private/qevdevkeyboardmanager_p.h>
+#endif
+
 QT_BEGIN_NAMESPACE
 
 QBsdFbIntegration::QBsdFbIntegration(const QStringList &paramList)
 {
-    m_fontDb.reset(new QGenericUnixFontDatabase);
-    m_services.reset(new QGenericUnixServices);
-    m_primaryScreen.reset(new QBsdFbScreen(paramList));
+    if (qEnvironmentVariableIntValue("QT_QPA_BSDFB_STARTUP"))
+        m_startup.reset(new QBsdFbStartup);
+    QBsdFbStartupPhase phase("integration");
+
+    // Every fb= argument adds a screen, all other arguments apply to each
+    QStringList common;
+    QStringList devices;
+    for (const QString &arg : paramList) {
+        if (arg.startsWith(QLatin1String("fb=")))
+            devices.append(arg);
+        else if (arg.startsWith(QLatin1String("fontsnapshot=")))
+            m_fontSnapshot = arg.mid(13);
+        else
+            common.append(arg);
+    }
+
+    // Give each head its own presenter thread so that a busy screen does
+    // not hold up the others; an explicit present= still wins
+    if (devices.size() > 1)
+        common.prepend(QStringLiteral("present=async"));
+    if (devices.isEmpty())
+        devices.append(QString());
+
+    for (const QString &device : qAsConst(devices)) {
+        QStringList args = common;
+        if (!device.isEmpty())
+            args.append(device);
+        m_screens.append(new QBsdFbScreen(args));
+    }
 }
 
 QBsdFbIntegration::~QBsdFbIntegration()
 {
-    destroyScreen(m_primaryScreen.data());
+    qDeleteAll(m_inputHandlers);
+    // Deletes the screens as well
+    for (QBsdFbScreen *screen : qAsConst(m_screens))
+        destroyScreen(screen);
 }
 
 void QBsdFbIntegration::initialize()
 {
-    if (m_primaryScreen->initialize())
-        screenAdded(m_primaryScreen.data());
-    else
-        qWarning("bsdfb: Failed to initialize screen");
+    const QByteArray traceFile = qgetenv("QT_QPA_BSDFB_TRACE");
+    if (!traceFile.isEmpty()) {
+        int capacity = qEnvironmentVariableIntValue("QT_QPA_BSDFB_TRACE_EVENTS");
+        if (capacity <= 0)
+            capacity = QBsdFbTracer::DefaultCapacity;
+        m_tracer.reset(new QBsdFbTracer(QFile::decodeName(traceFile), capacity));
+    }
 
-    m_inputContext.reset(QPlatformInputContextFactory::create());
-    m_nativeInterface.reset(new QPlatformNativeInterface);
-    m_vtHandler.reset(new QFbVtHandler);
+    // Screens are placed side by side in a virtual desktop
+    QList<QPlatformScreen *> siblings;
+    int x = 0;
+    for (auto it = m_screens.begin(); it != m_screens.end(); ) {
+        QBsdFbScreen *screen = *it;
+        QBsdFbStartupPhase phase("screen");
+        if (!screen->initialize()) {
+            qWarning("bsdfb: Failed to initialize screen");
+            // Never added, so destroyScreen() must not see it
+            delete screen;
+            it = m_screens.erase(it);
+            continue;
+        }
+        ++it;
+        screen->setVirtualPosition(QPoint(x, 0));
+        x += screen->geometry().width();
+        siblings.append(screen);
+    }
+
+    for (QPlatformScreen *screen : qAsConst(siblings)) {
+        static_cast<QBsdFbScreen *>(screen)->setVirtualSiblings(siblings);
+        screenAdded(screen);
+    }
 
-    if (!qEnvironmentVariableIntValue("QT_QPA_FB_DISABLE_INPUT"))
+    // Switches the console to graphics mode, so it stays ahead of the
+    // first frame
+    {
+        QBsdFbStartupPhase phase("vt");
+        m_vtHandler.reset(new QFbVtHandler);
+    }
+
+    if (!qEnvironmentVariableIntValue("QT_QPA_FB_DISABLE_INPUT")) {
+        QBsdFbStartupPhase phase("input");
         createInputHandlers();
+    }
 }
 
 bool QBsdFbIntegration::hasCapability(QPlatformIntegration::Capability cap) const
@@ -95,7 +170,7 @@ bool QBsdFbIntegration::hasCapability(QPlatformIntegration::Capability cap) cons
 
 QPlatformBackingStore *QBsdFbIntegration::createPlatformBackingStore(QWindow *window) const
 {
-    return new QFbBackingStore(window);
+    return new QBsdFbBackingStore(window);
 }
 
 QPlatformWindow *QBsdFbIntegration::createPlatformWindow(QWindow *window) const
@@ -105,26 +180,61 @@ QPlatformWindow *QBsdFbIntegration::createPlatformWindow(QWindow *window) const
 
 QAbstractEventDispatcher *QBsdFbIntegration::createEventDispatcher() const
 {
+    const QByteArray backend = qgetenv("QT_QPA_BSDFB_EVENTDISPATCHER");
+    if (!backend.isEmpty() && backend != "generic") {
+#if defined(QBSDFB_EVENTDISPATCHER_KQUEUE) || defined(QBSDFB_EVENTDISPATCHER_EPOLL)
+        if (backend == QBsdFbEventDispatcher::backendName()) {
+            QBsdFbGuiEventDispatcher *dispatcher = new QBsdFbGuiEventDispatcher;
+            if (dispatcher->isValid())
+                return dispatcher;
+            delete dispatcher;
+        } else
+#endif
+        {
+            qWarning("bsdfb: Event dispatcher '%s' is not available, using the generic one",
+                     backend.constData());
+        }
+    }
+
     return createUnixEventDispatcher();
 }
 
 QList<QPlatformScreen *> QBsdFbIntegration::screens() const
 {
     QList<QPlatformScreen *> list;
-    list.append(m_primaryScreen.data());
+    for (QBsdFbScreen *screen : m_screens)
+        list.append(screen);
     return list;
 }
 
+// The fonts themselves are populated by QFontDatabase on first use
 QPlatformFontDatabase *QBsdFbIntegration::fontDatabase() const
 {
+    if (!m_fontDb)
+        m_fontDb.reset(new QBsdFbFontDatabase(m_fontSnapshot));
     return m_fontDb.data();
 }
 
 QPlatformServices *QBsdFbIntegration::services() const
 {
+    if (!m_services) {
+        QBsdFbStartupPhase phase("services");
+        m_services.reset(new QGenericUnixServices);
+    }
     return m_services.data();
 }
 
+// Loading the input method plugin is left to the first text input
+QPlatformInputContext *QBsdFbIntegration::inputContext() const
+{
+    if (!m_inputContextCreated) {
+        QBsdFbStartupPhase phase("input context");
+        m_inputContext.reset(QPlatformInputContextFactory::create());
+        m_inputContextCreated = true;
+    }
+    return m_inputContext.data();
+}
+
 void QBsdFbIntegration::createInputHandlers()
 {
 #ifndef QT_NO_TSLIB
@@ -132,11 +242,91 @@ void QBsdFbIntegration::createInputHandlers()
     if (useTslib)
         new QTsLibMouseHandler(QLatin1String("TsLib"), QString());
 #endif
+
+    // Devices as type:path separated by ';', for example
+    // sysmouse:/dev/sysmouse;evdev:/dev/input/event2;keyboard:/dev/input/event0
+    // replay-sysmouse:<file> and replay-evdev:<file> play back a recording.
+    const QString spec = QString::fromLocal8Bit(qgetenv("QT_QPA_BSDFB_INPUT"));
+    const QStringList entries = spec.split(QLatin1Char(';'), QString::SkipEmptyParts);
+    int pointers = 0;
+    for (const QString &entry : entries) {
+        const int colon = entry.indexOf(QLatin1Char(':'));
+        const QString type = entry.left(colon);
+        const QString path = entry.mid(colon + 1);
+        if (colon < 0 || path.isEmpty()) {
+            qWarning("bsdfb: Invalid input device '%s'", qPrintable(entry));
+            continue;
+        }
+
+        QObject *handler = nullptr;
+        if (type == QLatin1String("sysmouse")) {
+            handler = QBsdFbPointerHandler::create(QBsdFbPointerHandler::SysMouse, path);
+        } else if (type == QLatin1String("evdev")) {
+            handler = QBsdFbPointerHandler::create(QBsdFbPointerHandler::Evdev, path);
+        } else if (type.startsWith(QLatin1String("replay-"))) {
+            const QBsdFbPointerHandler::Protocol protocol = type == QLatin1String("replay-evdev")
+                    ? QBsdFbPointerHandler::Evdev : QBsdFbPointerHandler::SysMouse;
+            QBsdFbInputReplay *replay = new QBsdFbInputReplay(protocol, path);
+            if (replay->isValid())
+                handler = replay;
+            else
+                delete replay;
+#if !defined(QT_NO_EVDEV)
+        } else if (type == QLatin1String("keyboard")) {
+            // Only evdev keyboards are supported. Keeps its own keyboard count
+            m_inputHandlers.append(new QEvdevKeyboardManager(QLatin1String("EvdevKeyboard"), path));
+            continue;
+#endif
+        } else {
+            qWarning("bsdfb: Unknown input device type '%s'", qPrintable(type));
+        }
+
+        if (handler) {
+            m_inputHandlers.append(handler);
+            ++pointers;
+        }
+    }
+
+    if (pointers) {
+        QInputDeviceManagerPrivate::get(QGuiApplicationPrivate::inputDeviceManager())
+                ->setDeviceCount(QInputDeviceManager::DeviceTypePointer, pointers);
+    }
 }
 
 QPlatformNativeInterface *QBsdFbIntegration::nativeInterface() const
 {
-    return m_nativeInterface.data();
+    return const_cast<QBsdFbIntegration *>(this);
+}
+
+void *QBsdFbIntegration::nativeResourceForScreen(const QByteArray &resource, QScreen *screen)
+{
+    if (!screen || !screen->handle())
+        return nullptr;
+
+    const QBsdFbScreen *fbScreen = static_cast<const QBsdFbScreen *>(screen->handle());
+    if (resource == "tilecachestats" && fbScreen->tileCache())
+        return const_cast<QBsdFbTileCache::Stats *>(fbScreen->tileCache()->stats());
+    if (resource == "framestats" && fbScreen->frameStats())
+        return const_cast<QBsdFbFrameStats::Ring *>(fbScreen->frameStats()->ring());
+
+    return nullptr;
+}
+
+// Repeated screenshots without allocating: the image must have the size
+// of rect and is converted if its format differs from the screen's.
+static bool grabScreen(QScreen *screen, const QRect &rect, QImage *image)
+{
+    if (!screen || !screen->handle() || !image)
+        return false;
+    return static_cast<const QBsdFbScreen *>(screen->handle())->grabInto(rect, image);
+}
+
+QPlatformNativeInterface::NativeResourceForScreenFunction QBsdFbIntegration::nativeResourceFunctionForScreen(const QByteArray &resource)
+{
+    if (resource == "grabscreen")
+        return reinterpret_cast<NativeResourceForScreenFunction>(grabScreen);
+
+    return nullptr;
 }
 
 QT_END_NAMESPACE
@@ -36,12 +36,15 @@
 
 #include <qpa/qplatformintegration.h>
 #include <qpa/qplatformnativeinterface.h>
+#include <QtCore/QVector>
 
 QT_BEGIN_NAMESPACE
 
 class QAbstractEventDispatcher;
 class QBsdFbScreen;
 class QFbVtHandler;
+class QBsdFbTracer;
+class QBsdFbStartup;
 
 class QBsdFbIntegration : public QPlatformIntegration, public QPlatformNativeInterface
 {
@@ -59,21 +62,29 @@ public:
 
     QPlatformFontDatabase *fontDatabase() const override;
     QPlatformServices *services() const override;
-    QPlatformInputContext *inputContext() const override { return m_inputContext.data(); }
+    QPlatformInputContext *inputContext() const override;
 
     QPlatformNativeInterface *nativeInterface() const override;
+    void *nativeResourceForScreen(const QByteArray &resource, QScreen *screen) override;
+    NativeResourceForScreenFunction nativeResourceFunctionForScreen(const QByteArray &resource) override;
 
     QList<QPlatformScreen *> screens() const;
 
 private:
     void createInputHandlers();
 
-    QScopedPointer<QBsdFbScreen> m_primaryScreen;
-    QScopedPointer<QPlatformInputContext> m_inputContext;
-    QScopedPointer<QPlatformFontDatabase> m_fontDb;
-    QScopedPointer<QPlatformServices> m_services;
+    QString m_fontSnapshot;
+    QScopedPointer<QBsdFbStartup> m_startup;
+    QScopedPointer<QBsdFbTracer> m_tracer;
+    QVector<QBsdFbScreen *> m_screens;
+
+    // Created on first use, they are not needed for the first frame
+    mutable QScopedPointer<QPlatformInputContext> m_inputContext;
+    mutable QScopedPointer<QPlatformFontDatabase> m_fontDb;
+    mutable QScopedPointer<QPlatformServices> m_services;
+    mutable bool m_inputContextCreated = false;
     QScopedPointer<QFbVtHandler> m_vtHandler;
-    QScopedPointer<QPlatformNativeInterface> m_nativeInterface;
+    QVector<QObject *> m_inputHandlers;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,260 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbmirror.h"
+
+#include <QtCore/QFile>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+QT_BEGIN_NAMESPACE
+
+enum {
+    // Keeps the ring page aligned
+    MirrorDataOffset = 4096,
+    MaxLiteral = 128,
+    MaxRepeat = 129
+};
+
+static int mirrorFormat(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGB16:
+        return MirrorRGB16;
+    case QImage::Format_RGB888:
+        return MirrorRGB888;
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        return MirrorXRGB32;
+    default:
+        return 0;
+    }
+}
+
+QBsdFbMirror::~QBsdFbMirror()
+{
+    if (m_map)
+        munmap(m_map, m_mapSize);
+}
+
+bool QBsdFbMirror::open(const QString &fileName, const QSize &size, QImage::Format format, qint64 ringSize)
+{
+    const int mirror = mirrorFormat(format);
+    if (!mirror) {
+        qWarning("bsdfb: Cannot mirror image format %d", int(format));
+        return false;
+    }
+
+    m_fileName = fileName;
+    m_bytesPerPixel = QImage::toPixelFormat(format).bitsPerPixel() / 8;
+
+    // Room for at least two full frames so that a keyframe always fits
+    const quint64 frameSize = sizeof(QBsdFbMirrorRecord) + sizeof(QBsdFbMirrorRect)
+            + qbsdfbMirrorAlign(quint64(size.width()) * size.height() * m_bytesPerPixel);
+    m_dataSize = qbsdfbMirrorAlign(qMax<quint64>(ringSize, 2 * frameSize));
+    m_mapSize = MirrorDataOffset + m_dataSize;
+
+    const int fd = ::open(QFile::encodeName(fileName).constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        qErrnoWarning(errno, "bsdfb: Failed to open mirror file %s", qPrintable(fileName));
+        return false;
+    }
+
+    if (ftruncate(fd, off_t(m_mapSize)) != 0) {
+        qErrnoWarning(errno, "bsdfb: Failed to resize mirror file %s", qPrintable(fileName));
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        qErrnoWarning(errno, "bsdfb: Failed to map mirror file %s", qPrintable(fileName));
+        return false;
+    }
+
+    m_map = static_cast<uchar *>(map);
+    m_header = reinterpret_cast<QBsdFbMirrorHeader *>(m_map);
+    m_ring = m_map + MirrorDataOffset;
+
+    m_header->version = QBsdFbMirrorVersion;
+    m_header->width = size.width();
+    m_header->height = size.height();
+    m_header->format = mirror;
+    m_header->bytesPerPixel = m_bytesPerPixel;
+    m_header->keyFrameRequest = 0;
+    m_header->dataOffset = MirrorDataOffset;
+    m_header->dataSize = m_dataSize;
+    m_header->writePosition = 0;
+    m_header->reservePosition = 0;
+    __atomic_store_n(&m_header->magic, uint32_t(QBsdFbMirrorMagic), __ATOMIC_RELEASE);
+
+    return true;
+}
+
+// Returns contiguous space for a record of up to size bytes. Consumers
+// learn through reservePosition that this part of the ring is going away.
+uchar *QBsdFbMirror::reserve(quint64 size)
+{
+    quint64 offset = m_position % m_dataSize;
+    quint64 padding = offset + size > m_dataSize ? m_dataSize - offset : 0;
+
+    __atomic_store_n(&m_header->reservePosition, m_position + padding + size, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (padding) {
+        uint32_t *record = reinterpret_cast<uint32_t *>(m_ring + offset);
+        record[0] = MirrorPaddingRecord;
+        record[1] = uint32_t(padding);
+        m_position += padding;
+        offset = 0;
+    }
+
+    return m_ring + offset;
+}
+
+static inline bool samePixel(const uchar *a, const uchar *b, int bpp)
+{
+    return memcmp(a, b, bpp) == 0;
+}
+
+// Run-length encodes the rect into dst. Returns -1 if the result would not
+// be smaller than the raw pixels, in which case dst holds garbage.
+int QBsdFbMirror::encodeRect(uchar *dst, const QImage &source, const QRect &rect) const
+{
+    const int bpp = m_bytesPerPixel;
+    const int count = rect.width();
+    const uchar *limit = dst + count * rect.height() * bpp;
+    uchar *out = dst;
+
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        const uchar *src = source.constScanLine(y) + rect.x() * bpp;
+        int i = 0;
+        while (i < count) {
+            const uchar *pixel = src + i * bpp;
+            int run = 1;
+            while (i + run < count && run < MaxRepeat && samePixel(pixel + run * bpp, pixel, bpp))
+                ++run;
+
+            if (run >= 2) {
+                if (out + 1 + bpp >= limit)
+                    return -1;
+                *out++ = uchar(run + 126);
+                memcpy(out, pixel, bpp);
+                out += bpp;
+                i += run;
+                continue;
+            }
+
+            // Literals up to the next pair of equal pixels
+            int literal = 1;
+            while (i + literal < count && literal < MaxLiteral
+                   && !(i + literal + 1 < count && samePixel(pixel + literal * bpp, pixel + (literal + 1) * bpp, bpp)))
+                ++literal;
+
+            if (out + 1 + literal * bpp >= limit)
+                return -1;
+            *out++ = uchar(literal - 1);
+            memcpy(out, pixel, literal * bpp);
+            out += literal * bpp;
+            i += literal;
+        }
+    }
+
+    return int(out - dst);
+}
+
+void QBsdFbMirror::publish(const QImage &source, const QRegion &region)
+{
+    QRegion damage = region;
+    uint32_t flags = 0;
+    if (m_sequence == 0 || __atomic_exchange_n(&m_header->keyFrameRequest, 0, __ATOMIC_ACQ_REL)) {
+        damage = source.rect();
+        flags = MirrorKeyFrame;
+    }
+
+    QVector<QRect> rects = damage.rects();
+    quint64 size = sizeof(QBsdFbMirrorRecord);
+    for (const QRect &rect : qAsConst(rects))
+        size += sizeof(QBsdFbMirrorRect) + qbsdfbMirrorAlign(quint64(rect.width()) * rect.height() * m_bytesPerPixel);
+
+    // Only a heavily fragmented region can get this large
+    if (size > m_dataSize / 2) {
+        rects = QVector<QRect>() << source.rect();
+        size = sizeof(QBsdFbMirrorRecord) + sizeof(QBsdFbMirrorRect)
+                + qbsdfbMirrorAlign(quint64(source.width()) * source.height() * m_bytesPerPixel);
+    }
+
+    uchar *record = reserve(size);
+    uchar *out = record + sizeof(QBsdFbMirrorRecord);
+
+    for (const QRect &rect : qAsConst(rects)) {
+        QBsdFbMirrorRect *header = reinterpret_cast<QBsdFbMirrorRect *>(out);
+        uchar *data = out + sizeof(QBsdFbMirrorRect);
+        header->x = rect.x();
+        header->y = rect.y();
+        header->width = rect.width();
+        header->height = rect.height();
+
+        int bytes = encodeRect(data, source, rect);
+        if (bytes >= 0) {
+            header->encoding = MirrorRle;
+        } else {
+            const int rowBytes = rect.width() * m_bytesPerPixel;
+            for (int y = 0; y < rect.height(); ++y)
+                memcpy(data + y * rowBytes, source.constScanLine(rect.y() + y) + rect.x() * m_bytesPerPixel, rowBytes);
+            header->encoding = MirrorRaw;
+            bytes = rowBytes * rect.height();
+        }
+        header->size = bytes;
+        out = data + qbsdfbMirrorAlign(bytes);
+    }
+
+    QBsdFbMirrorRecord *frame = reinterpret_cast<QBsdFbMirrorRecord *>(record);
+    frame->type = MirrorFrameRecord;
+    frame->size = uint32_t(out - record);
+    frame->sequence = ++m_sequence;
+    frame->rectCount = rects.size();
+    frame->flags = flags;
+
+    m_position += frame->size;
+    __atomic_store_n(&m_header->writePosition, m_position, __ATOMIC_RELEASE);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,77 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBMIRROR_H
+#define QBSDFBMIRROR_H
+
+#include "qbsdfbmirrorprotocol.h"
+
+#include <QtGui/QImage>
+#include <QtGui/QRegion>
+
+QT_BEGIN_NAMESPACE
+
+// Publishes the damage of every frame into a shared memory ring so that
+// another process can mirror the screen. See qbsdfbmirrorprotocol.h for
+// the format.
+class QBsdFbMirror
+{
+public:
+    QBsdFbMirror() = default;
+    ~QBsdFbMirror();
+
+    bool open(const QString &fileName, const QSize &size, QImage::Format format, qint64 ringSize);
+
+    void publish(const QImage &source, const QRegion &region);
+
+private:
+    uchar *reserve(quint64 size);
+    int encodeRect(uchar *dst, const QImage &source, const QRect &rect) const;
+
+    QString m_fileName;
+    uchar *m_map = nullptr;
+    size_t m_mapSize = 0;
+    QBsdFbMirrorHeader *m_header = nullptr;
+    uchar *m_ring = nullptr;
+    quint64 m_dataSize = 0;
+    quint64 m_position = 0;
+    quint64 m_sequence = 0;
+    int m_bytesPerPixel = 0;
+
+    Q_DISABLE_COPY(QBsdFbMirror)
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBMIRROR_H
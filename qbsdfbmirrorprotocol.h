@@ -0,0 +1,135 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBMIRRORPROTOCOL_H
+#define QBSDFBMIRRORPROTOCOL_H
+
+// Layout of the damage stream written by the mirror=<file> option. This
+// header does not depend on Qt so that consumers can include it as is.
+//
+// The file starts with a QBsdFbMirrorHeader, followed at dataOffset by a
+// ring of dataSize bytes. Positions are byte counts since the stream was
+// created; position p lives at ring offset p % dataSize. Records start at
+// 8 byte aligned positions and never wrap: when a record does not fit
+// before the end of the ring the producer fills the rest with a padding
+// record and continues at offset 0.
+//
+// A frame record is a QBsdFbMirrorRecord followed by rectCount rects.
+// Each rect is a QBsdFbMirrorRect followed by size bytes of pixel data,
+// padded to a multiple of 8. Raw data is height rows of width pixels with
+// no padding between rows. RLE data encodes each row separately as a
+// sequence of runs, each starting with a control byte c:
+//   c < 128   c + 1 literal pixels follow
+//   c >= 128  one pixel follows, repeated c - 126 times
+// Pixels are stored in the byte order of the producer.
+//
+// Padding records may be as short as 8 bytes, only type and size are
+// valid in them.
+//
+// The producer advances reservePosition, followed by a release fence,
+// before it overwrites any part of the ring, and stores writePosition
+// with release semantics once a record is complete. A consumer keeps its
+// own read position r and may parse records up to writePosition. After
+// copying a record that starts at r it must issue an acquire fence and
+// check that reservePosition - dataSize <= r still holds, otherwise the
+// copy may be torn. A consumer that fell behind stores 1 to
+// keyFrameRequest and waits for a record with MirrorKeyFrame, which
+// covers the whole screen. The header is valid once magic is set.
+
+#include <stdint.h>
+
+enum {
+    QBsdFbMirrorMagic = 0x4d424642, // "BFBM"
+    QBsdFbMirrorVersion = 1
+};
+
+enum QBsdFbMirrorFormat {
+    MirrorRGB16 = 1,    // 16 bit 5-6-5
+    MirrorRGB888 = 2,   // bytes R, G, B
+    MirrorXRGB32 = 3    // 32 bit 0xffRRGGBB, upper byte undefined
+};
+
+enum QBsdFbMirrorRecordType {
+    MirrorFrameRecord = 1,
+    MirrorPaddingRecord = 2
+};
+
+enum QBsdFbMirrorEncoding {
+    MirrorRaw = 0,
+    MirrorRle = 1
+};
+
+enum QBsdFbMirrorFlags {
+    MirrorKeyFrame = 1
+};
+
+struct QBsdFbMirrorHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t bytesPerPixel;
+    uint32_t keyFrameRequest;
+    uint32_t reserved;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+    uint64_t writePosition;
+    uint64_t reservePosition;
+};
+
+// size covers the whole record including its rects and padding
+struct QBsdFbMirrorRecord {
+    uint32_t type;
+    uint32_t size;
+    uint64_t sequence;
+    uint32_t rectCount;
+    uint32_t flags;
+};
+
+struct QBsdFbMirrorRect {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint32_t encoding;
+    uint32_t size;
+};
+
+static inline uint64_t qbsdfbMirrorAlign(uint64_t size)
+{
+    return (size + 7) & ~uint64_t(7);
+}
+
+#endif // QBSDFBMIRRORPROTOCOL_H
@@ -0,0 +1,140 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbpresenter.h"
+#include "qbsdfbscreen.h"
+#include "qbsdfbframestats.h"
+#include "qbsdfbarena.h"
+
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+QBsdFbPresenter::QBsdFbPresenter(QBsdFbScreen *screen, const QSize &size, QImage::Format format,
+                                 QBsdFbArena *arena)
+    : m_screen(screen),
+      m_ready(2)
+{
+    for (int i = 0; i < BufferCount; ++i) {
+        if (arena)
+            m_buffers[i] = arena->allocate(size, format);
+        if (m_buffers[i].isNull())
+            m_buffers[i] = QImage(size, format);
+        m_stale[i] = QRect(QPoint(0, 0), size);
+        m_sequences[i] = 0;
+    }
+
+    setObjectName(QStringLiteral("QBsdFbPresenter"));
+    start(QThread::HighPriority);
+}
+
+QBsdFbPresenter::~QBsdFbPresenter()
+{
+    m_quit.storeRelease(1);
+    m_wake.release();
+    wait();
+}
+
+void QBsdFbPresenter::queue(const QImage &source, const QRegion &region)
+{
+    // The previous frame may still be waiting; if the presenter does not
+    // pick it up before the exchange below, it is dropped, so this frame
+    // has to cover its damage too.
+    QRegion damage = region;
+    if (m_ready.loadAcquire() & Fresh)
+        damage += m_lastRegion;
+
+    QRegion copy = damage + m_stale[m_back];
+    m_stale[m_back] = QRegion();
+    for (int i = 0; i < BufferCount; ++i) {
+        if (i == m_back)
+            continue;
+        m_stale[i] += region;
+        // Keep the region operations cheap when damage is very fragmented
+        if (m_stale[i].rectCount() > MaxStaleRects)
+            m_stale[i] = m_stale[i].boundingRect();
+    }
+
+    QImage &buffer = m_buffers[m_back];
+    const int bytesPerPixel = buffer.depth() / 8;
+    const auto rects = copy.rects();
+    for (const QRect &rect : rects) {
+        const int rowBytes = rect.width() * bytesPerPixel;
+        const int offset = rect.x() * bytesPerPixel;
+        for (int y = rect.top(); y <= rect.bottom(); ++y)
+            memcpy(buffer.scanLine(y) + offset, source.constScanLine(y) + offset, rowBytes);
+    }
+
+    m_regions[m_back] = damage;
+    m_sequences[m_back] = ++m_published;
+    m_lastRegion = damage;
+
+    m_back = m_ready.fetchAndStoreOrdered(m_back | Fresh) & ~Fresh;
+    m_wake.release();
+}
+
+void QBsdFbPresenter::waitForIdle()
+{
+    QMutexLocker lock(&m_idleMutex);
+    while (m_presented.loadAcquire() != m_published)
+        m_idle.wait(&m_idleMutex);
+}
+
+void QBsdFbPresenter::run()
+{
+    forever {
+        m_wake.acquire();
+        if (m_quit.loadAcquire())
+            break;
+
+        if (!(m_ready.loadAcquire() & Fresh))
+            continue;
+
+        m_front = m_ready.fetchAndStoreOrdered(m_front) & ~Fresh;
+        m_screen->present(m_buffers[m_front], m_regions[m_front]);
+
+        const int sequence = m_sequences[m_front];
+        if (Q_UNLIKELY(m_screen->frameStats()) && sequence - m_lastSequence > 1)
+            m_screen->frameStats()->addSkipped(sequence - m_lastSequence - 1);
+        m_lastSequence = sequence;
+        m_presented.storeRelease(sequence);
+
+        // Taking the mutex orders the wakeup after a waiter's check
+        m_idleMutex.lock();
+        m_idle.wakeAll();
+        m_idleMutex.unlock();
+    }
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,106 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBPRESENTER_H
+#define QBSDFBPRESENTER_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <QtGui/QImage>
+#include <QtGui/QRegion>
+
+QT_BEGIN_NAMESPACE
+
+class QBsdFbScreen;
+class QBsdFbArena;
+
+// Writes frames to the framebuffer on a separate thread. The GUI thread
+// copies the damaged area of each composed frame into one of three shadow
+// buffers and publishes it with a single atomic exchange; the presenter
+// always picks up the newest frame. When a frame is replaced before it was
+// presented, its damage is carried into the frame that replaces it.
+//
+// Each buffer is also brought up to date with the frames written to the
+// other buffers since it was last used, so a published buffer always holds
+// the complete frame, not just its damage.
+class QBsdFbPresenter : public QThread
+{
+public:
+    QBsdFbPresenter(QBsdFbScreen *screen, const QSize &size, QImage::Format format, QBsdFbArena *arena = nullptr);
+    ~QBsdFbPresenter() override;
+
+    void queue(const QImage &source, const QRegion &region);
+    void waitForIdle();
+
+protected:
+    void run() override;
+
+private:
+    enum {
+        BufferCount = 3,
+        Fresh = 0x4,
+        MaxStaleRects = 64
+    };
+
+    QBsdFbScreen *m_screen;
+    QImage m_buffers[BufferCount];
+    QRegion m_regions[BufferCount];
+    QRegion m_stale[BufferCount];
+    int m_sequences[BufferCount];
+
+    // Owned by the GUI thread
+    int m_back = 0;
+    int m_published = 0;
+    QRegion m_lastRegion;
+
+    // Owned by the presenter thread
+    int m_front = 1;
+    int m_lastSequence = 0;
+
+    QAtomicInt m_ready;
+    QAtomicInt m_presented;
+    QAtomicInt m_quit;
+    QSemaphore m_wake;
+
+    // Signalled by the presenter thread after every frame
+    QMutex m_idleMutex;
+    QWaitCondition m_idle;
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBPRESENTER_H
@@ -33,49 +33,42 @@
 ****************************************************************************/
 
 #include "qbsdfbscreen.h"
+#include "qbsdfbdevice.h"
+#include "qbsdfbbackingstore.h"
+#include "qbsdfbpresenter.h"
+#include "qbsdfbtilecache.h"
+#include "qbsdfbframestats.h"
+#include "qbsdfbtracer.h"
+#include "qbsdfbmirror.h"
+#include "qbsdfbcursor.h"
+#include "qbsdfbstartup.h"
+#include "qbsdfbarena.h"
 #include <QtPlatformSupport/private/qfbcursor_p.h>
 #include <QtPlatformSupport/private/qfbwindow_p.h>
 #include <QtCore/QRegularExpression>
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimerEvent>
 #include <QtGui/QPainter>
 
-#include <private/qcore_unix_p.h> // overrides QT_OPEN
 #include <qimage.h>
 #include <qdebug.h>
 
-#include <unistd.h>
-#include <stdlib.h>
-#include <sys/ioctl.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <sys/mman.h>
-#include <fcntl.h>
-#include <errno.h>
-#include <stdio.h>
-#include <limits.h>
-#include <signal.h>
-
-#include <sys/consio.h>
-#include <sys/fbio.h>
+#include <string.h>
 
 QT_BEGIN_NAMESPACE
 
+Q_LOGGING_CATEGORY(qLcBsdFb, "qt.qpa.bsdfb")
+
 enum {
-    DefaultDPI = 100
+    DefaultDPI = 100,
+    // Below this many pixels handing bands to the blit threads costs more
+    // than it saves
+    ParallelBlitThreshold = 256 * 256
 };
 
-static int openFramebufferDevice(const QString &dev)
-{
-    const QByteArray devPath = QFile::encodeName(dev);
-
-    int fd = QT_OPEN(devPath.constData(), O_RDWR);
-
-    if (fd == -1)
-        fd = QT_OPEN(devPath.constData(), O_RDONLY);
-
-    return fd;
-}
-
-static QRect determineGeometry(const struct fbtype &fb, const QRect &userGeometry)
+static QRect determineGeometry(const QSize &fbSize, const QRect &userGeometry)
 {
     int xoff = 0;
     int yoff = 0;
@@ -83,24 +76,24 @@ static QRect determineGeometry(const struct fbtype &fb, const QRect &userGeometr
     int h = 0;
 
     if (userGeometry.isValid()) {
-        w = qMin(userGeometry.width(), fb.fb_width);
-        h = qMin(userGeometry.height(), fb.fb_height);
+        w = qMin(userGeometry.width(), fbSize.width());
+        h = qMin(userGeometry.height(), fbSize.height());
 
         int xxoff = userGeometry.x(), yyoff = userGeometry.y();
         if (xxoff != 0 || yyoff != 0) {
-            if (xxoff < 0 || xxoff + w > fb.fb_width)
-                xxoff = fb.fb_width - w;
-            if (yyoff < 0 || yyoff + h > fb.fb_height)
-                yyoff = fb.fb_height - h;
+            if (xxoff < 0 || xxoff + w > fbSize.width())
+                xxoff = fbSize.width() - w;
+            if (yyoff < 0 || yyoff + h > fbSize.height())
+                yyoff = fbSize.height() - h;
             xoff += xxoff;
             yoff += yyoff;
         } else {
-            xoff += (fb.fb_width - w)/2;
-            yoff += (fb.fb_height - h)/2;
+            xoff += (fbSize.width() - w)/2;
+            yoff += (fbSize.height() - h)/2;
         }
     } else {
-        w = fb.fb_width;
-        h = fb.fb_height;
+        w = fbSize.width();
+        h = fbSize.height();
     }
 
     if (w == 0 || h == 0) {
@@ -137,9 +130,23 @@ QBsdFbScreen::QBsdFbScreen(const QStringList &args)
 
 QBsdFbScreen::~QBsdFbScreen()
 {
-    if (m_framebufferFd != -1) {
-        munmap(m_mmap.data - m_mmap.offset, m_mmap.size);
-        qt_safe_close(m_framebufferFd);
+    // Stop writing to the framebuffer before it is unmapped
+    m_presenter.reset();
+    m_blitPool.reset();
+
+    // The composed image may live in the arena, which is gone by the time
+    // the base class deletes it
+    m_composePainter.reset();
+    delete mScreenImage;
+    mScreenImage = nullptr;
+
+    if (m_pageCount > 1)
+        m_device->setDisplayStart(0, 0);
+
+    if (m_tileCache) {
+        const QBsdFbTileCache::Stats *stats = m_tileCache->stats();
+        qCDebug(qLcBsdFb, "Tile cache: %llu of %llu tiles unchanged",
+                stats->tilesUnchanged, stats->tilesChecked);
     }
 }
 
@@ -149,10 +156,42 @@ bool QBsdFbScreen::initialize()
     QRegularExpression mmSizeRx(QLatin1String("mmsize=(\\d+)x(\\d+)"));
     QRegularExpression sizeRx(QLatin1String("size=(\\d+)x(\\d+)"));
     QRegularExpression offsetRx(QLatin1String("offset=(\\d+)x(\\d+)"));
+    QRegularExpression compositionRx(QLatin1String("composition=(native)"));
+    QRegularExpression scanoutRx(QLatin1String("scanout=(shadow|direct)"));
+    QRegularExpression presentRx(QLatin1String("present=(async|sync)"));
+    QRegularExpression blitThreadsRx(QLatin1String("blitthreads=(\\d+)"));
+    QRegularExpression statsRx(QLatin1String("stats=(on|off)"));
+    QRegularExpression fpsRx(QLatin1String("fps=(\\d+)"));
+    QRegularExpression flipRx(QLatin1String("flip=(on|off)"));
+    QRegularExpression tileCacheRx(QLatin1String("tilecache=(\\d+)"));
+    QRegularExpression damageMergeRx(QLatin1String("damagemerge=(\\d*\\.?\\d+)"));
+    QRegularExpression mirrorRx(QLatin1String("mirror=(.+)"));
+    QRegularExpression mirrorSizeRx(QLatin1String("mirrorsize=(\\d+)"));
+    QRegularExpression cursorRx(QLatin1String("cursor=(plane|compose)"));
+    QRegularExpression rotationRx(QLatin1String("rotation=(0|90|180|270)"));
+    QRegularExpression scaleRx(QLatin1String("scale=(\\d+)"));
+    QRegularExpression shadowRx(QLatin1String("shadow=(heap|aligned|hugepages)"));
+    QRegularExpression prefaultRx(QLatin1String("prefault=(on|off)"));
+    QRegularExpression streamRx(QLatin1String("stream=(on|off)"));
 
     QString fbDevice;
     QSize userMmSize;
     QRect userGeometry;
+    QString composition;
+    bool asyncPresent = false;
+    int tileSize = 0;
+    bool pageFlip = false;
+    QString mirrorFile;
+    int mirrorSize = 32;
+    bool cursorPlane = false;
+    int rotation = 0;
+    int scale = 1;
+    QString shadow = QStringLiteral("aligned");
+    bool prefault = true;
+    bool stream = true;
+    int fps = qEnvironmentVariableIntValue("QT_QPA_BSDFB_FPS");
+    // QT_QPA_BSDFB_STATS=N additionally prints a summary every N seconds
+    bool stats = qEnvironmentVariableIsSet("QT_QPA_BSDFB_STATS");
 
     // Parse arguments
     for (const QString &arg : qAsConst(m_arguments)) {
@@ -163,114 +202,794 @@ bool QBsdFbScreen::initialize()
             userGeometry.setSize(QSize(match.captured(1).toInt(), match.captured(2).toInt()));
         else if (arg.contains(offsetRx, &match))
             userGeometry.setTopLeft(QPoint(match.captured(1).toInt(), match.captured(2).toInt()));
+        else if (arg.contains(compositionRx, &match))
+            composition = match.captured(1);
+        else if (arg.contains(scanoutRx, &match))
+            m_scanoutMode = match.captured(1) == QLatin1String("direct") ? ScanoutDirect : ScanoutShadow;
+        else if (arg.contains(presentRx, &match))
+            asyncPresent = match.captured(1) == QLatin1String("async");
+        else if (arg.contains(blitThreadsRx, &match))
+            m_blitThreads = qBound(1, match.captured(1).toInt(), 16);
+        else if (arg.contains(statsRx, &match))
+            stats = match.captured(1) == QLatin1String("on");
+        else if (arg.contains(fpsRx, &match))
+            fps = match.captured(1).toInt();
+        else if (arg.contains(flipRx, &match))
+            pageFlip = match.captured(1) == QLatin1String("on");
+        else if (arg.contains(tileCacheRx, &match))
+            tileSize = match.captured(1).toInt();
+        else if (arg.contains(damageMergeRx, &match))
+            m_damageOptimizer.setWasteRatio(qBound(0.0, match.captured(1).toDouble(), 1.0));
+        else if (arg.contains(mirrorRx, &match))
+            mirrorFile = match.captured(1);
+        else if (arg.contains(mirrorSizeRx, &match))
+            mirrorSize = match.captured(1).toInt();
+        else if (arg.contains(cursorRx, &match))
+            cursorPlane = match.captured(1) == QLatin1String("plane");
+        else if (arg.contains(rotationRx, &match))
+            rotation = match.captured(1).toInt();
+        else if (arg.contains(scaleRx, &match))
+            scale = qBound(1, match.captured(1).toInt(), 8);
+        else if (arg.contains(shadowRx, &match))
+            shadow = match.captured(1);
+        else if (arg.contains(prefaultRx, &match))
+            prefault = match.captured(1) == QLatin1String("on");
+        else if (arg.contains(streamRx, &match))
+            stream = match.captured(1) == QLatin1String("on");
         else if (arg.contains(fbRx, &match))
             fbDevice = match.captured(1);
     }
 
-    if (!fbDevice.isEmpty()) {
-        // Open the device
-        m_framebufferFd = openFramebufferDevice(fbDevice);
-    } else {
-        m_framebufferFd = STDIN_FILENO;
+    m_device.reset(QBsdFbDevice::create(fbDevice));
+    if (!m_device->open())
+        return false;
+
+    mDepth = m_device->depth();
+
+    m_bytesPerLine = m_device->bytesPerLine();
+    const QRect geometry = determineGeometry(m_device->size(), userGeometry);
+    if (rotation && scale > 1) {
+        qWarning("bsdfb: Scaling cannot be combined with rotation, ignoring scale=%d", scale);
+        scale = 1;
     }
 
-    if (m_framebufferFd == -1) {
-        qErrnoWarning(errno, "Failed to open framebuffer %s", qPrintable(fbDevice));
+    // Qt sees the rotated or scaled down screen, the framebuffer keeps its
+    // own orientation and resolution. The physical size stays the same, so
+    // scaling lowers the logical DPI.
+    const bool transposed = rotation == 90 || rotation == 270;
+    mGeometry = QRect(QPoint(0, 0), transposed ? geometry.size().transposed() : geometry.size() / scale);
+
+    // Layouts without an exact QImage format, and palettes, which windows
+    // cannot paint into, get the closest format of the same size. Only the
+    // blitter then knows the real pixel layout.
+    const QBsdFbDevice::PixelLayout layout = m_device->layout();
+    if (layout == QBsdFbDevice::UnknownLayout) {
+        qWarning("bsdfb: Unsupported framebuffer pixel layout at depth %d", mDepth);
         return false;
     }
+    const QImage::Format deviceFormat = QBsdFbDevice::imageFormat(layout);
+    if (deviceFormat != QImage::Format_Invalid && deviceFormat != QImage::Format_Indexed8) {
+        mFormat = deviceFormat;
+    } else {
+        switch (QBsdFbDevice::bytesPerPixel(layout)) {
+        case 3:
+            mFormat = QImage::Format_RGB888;
+            break;
+        case 2:
+            mFormat = QImage::Format_RGB16;
+            break;
+        default:
+            mFormat = QImage::Format_RGB32;
+            break;
+        }
+    }
+    m_nativeFormat = deviceFormat == mFormat;
+    qCDebug(qLcBsdFb) << "Framebuffer layout" << QBsdFbDevice::layoutName(layout) << "composing as" << int(mFormat);
+    mPhysicalSize = determinePhysicalSize(userMmSize, geometry.size());
+    if (transposed)
+        mPhysicalSize.transpose();
 
-    struct fbtype fb;
-    if (ioctl(m_framebufferFd, FBIOGTYPE, &fb) != 0) {
-        qErrnoWarning(errno, "Error reading framebuffer information");
+    // mmap the framebuffer
+    uchar *data = m_device->map(prefault);
+    if (!data)
         return false;
+
+    m_mmap.offset = geometry.y() * m_bytesPerLine + geometry.x() * QBsdFbDevice::bytesPerPixel(layout);
+    m_mmap.data = data + m_mmap.offset;
+
+    QFbScreen::initializeCompositor();
+
+    // Composing in the device format turns presenting into a plain row copy
+    // and keeps the shadow image no larger than the framebuffer itself.
+    // Without a matching format the stand-in mFormat would mislabel the
+    // pixels, so the blitter converts from RGB32 instead.
+    QImage::Format composeFormat = mScreenImage->format();
+    if (!m_nativeFormat) {
+        if (composition == QLatin1String("native"))
+            qWarning("bsdfb: No image format matches the framebuffer layout, ignoring composition=native");
+        composeFormat = QImage::Format_RGB32;
+    } else if (composition == QLatin1String("native")) {
+        composeFormat = mFormat;
+    }
+
+    if (shadow != QLatin1String("heap"))
+        m_arena.reset(new QBsdFbArena(shadow == QLatin1String("hugepages"), prefault, rotation != 0));
+
+    QImage composed;
+    if (m_arena)
+        composed = m_arena->allocate(mGeometry.size(), composeFormat);
+    if (composed.isNull() && composeFormat != mScreenImage->format())
+        composed = QImage(mGeometry.size(), composeFormat);
+    if (!composed.isNull()) {
+        delete mScreenImage;
+        mScreenImage = new QImage(composed);
     }
 
-    int line_length = 0;
-    if (ioctl(m_framebufferFd, FBIO_GETLINEWIDTH, &line_length) != 0) {
-        qErrnoWarning(errno, "Error reading line length information");
+    if (m_nativeFormat)
+        m_onscreenImage = QImage(m_mmap.data, geometry.width(), geometry.height(), m_bytesPerLine, mFormat);
+
+    if (m_blitter.setFormats(mScreenImage->format(), layout)) {
+        if (layout == QBsdFbDevice::C8)
+            m_blitter.setPalette(m_device->palette());
+        if (stream && !m_blitter.setStreaming(true))
+            qCDebug(qLcBsdFb) << "No non-temporal stores on this CPU";
+        qCDebug(qLcBsdFb) << "Using blit kernel" << m_blitter.name()
+                          << (m_blitter.isStreaming() ? "with non-temporal stores" : "with cached stores");
+    } else if (m_nativeFormat) {
+        qCDebug(qLcBsdFb) << "No blit kernel for format" << int(mScreenImage->format()) << "to" << int(mFormat) << "- using QPainter";
+    } else {
+        qWarning("bsdfb: No blit kernel for framebuffer layout %s", QBsdFbDevice::layoutName(layout));
         return false;
     }
 
-    mDepth = fb.fb_depth;
-
-    m_bytesPerLine = line_length;
-    const QRect geometry = determineGeometry(fb, userGeometry);
-    mGeometry = QRect(QPoint(0, 0), geometry.size());
-    switch (mDepth) {
-    case 32:
-        mFormat = QImage::Format_RGB32;
-        break;
-    case 24:
-        mFormat = QImage::Format_RGB888;
-        break;
-    case 16:
-        // falling back
-    default:
-        mFormat = QImage::Format_RGB16;
-        break;
+    if (m_scanoutMode == ScanoutDirect && !m_nativeFormat) {
+        qWarning("bsdfb: Direct scanout needs an image format matching the framebuffer, using scanout=shadow");
+        m_scanoutMode = ScanoutShadow;
     }
-    mPhysicalSize = determinePhysicalSize(userMmSize, geometry.size());
 
-    // mmap the framebuffer
-    const size_t pagemask = getpagesize() - 1;
-    m_mmap.size = (m_bytesPerLine * fb.fb_height + pagemask) & ~pagemask;
-    uchar *data = static_cast<uchar*>(mmap(nullptr, m_mmap.size, PROT_READ | PROT_WRITE, MAP_SHARED, m_framebufferFd, 0));
-    if (data == MAP_FAILED) {
-        qErrnoWarning(errno, "Failed to mmap framebuffer");
-        return false;
+    if (scale > 1) {
+        m_scale = scale;
+        m_blitter.setScale(scale, mGeometry.width(), m_blitThreads);
+        if (m_scanoutMode == ScanoutDirect) {
+            qWarning("bsdfb: Direct scanout cannot be combined with scaling, using scanout=shadow");
+            m_scanoutMode = ScanoutShadow;
+        }
     }
 
-    m_mmap.offset = geometry.y() * m_bytesPerLine + geometry.x() * mDepth / 8;
-    m_mmap.data = data + m_mmap.offset;
+    if (rotation) {
+        m_rotation = rotation;
+        m_blitter.setRotation(rotation, mGeometry.size());
+        if (m_scanoutMode == ScanoutDirect) {
+            qWarning("bsdfb: Direct scanout cannot be combined with rotation, using scanout=shadow");
+            m_scanoutMode = ScanoutShadow;
+        }
+    }
 
-    QFbScreen::initializeCompositor();
-    m_onscreenImage = QImage(m_mmap.data, geometry.width(), geometry.height(), m_bytesPerLine, mFormat);
+    // Render into the hidden half of a framebuffer twice the visible height
+    // and pan to it once the frame is complete
+    if (pageFlip) {
+        if (!m_blitter.isValid()) {
+            qWarning("bsdfb: Page flipping needs a blit kernel, drawing to the visible framebuffer");
+        } else if (m_device->virtualHeight() < 2 * m_device->size().height() || !m_device->setDisplayStart(0, 0)) {
+            qWarning("bsdfb: Framebuffer cannot pan, drawing to the visible framebuffer");
+        } else {
+            m_pageCount = 2;
+            m_pageBytes = m_bytesPerLine * m_device->size().height();
+            // Neither page holds a composed frame yet
+            mRepaintRegion += QRect(QPoint(0, 0), mGeometry.size());
+            if (m_scanoutMode == ScanoutDirect) {
+                qWarning("bsdfb: Direct scanout cannot be combined with page flipping, using scanout=shadow");
+                m_scanoutMode = ScanoutShadow;
+            }
+        }
+    }
+
+    if (!mirrorFile.isEmpty()) {
+        m_mirror.reset(new QBsdFbMirror);
+        if (!m_mirror->open(mirrorFile, mGeometry.size(), mScreenImage->format(), qint64(mirrorSize) << 20)) {
+            m_mirror.reset();
+        } else if (m_scanoutMode == ScanoutDirect && mScreenImage->format() != mFormat) {
+            qWarning("bsdfb: Mirroring needs the framebuffer in the composition format, using scanout=shadow");
+            m_scanoutMode = ScanoutShadow;
+        }
+    }
+
+    if (stats)
+        m_frameStats.reset(new QBsdFbFrameStats(qEnvironmentVariableIntValue("QT_QPA_BSDFB_STATS")));
+
+    if (fps > 0) {
+        m_frameInterval = 1000000000LL / fps;
+        m_frameClock.start();
+        m_lastFrameTime = -m_frameInterval;
+    }
+
+    if (tileSize > 0)
+        m_tileCache.reset(new QBsdFbTileCache(mGeometry.size(), qBound(8, tileSize, 256)));
+
+    // The calling thread blits one band itself
+    if (m_blitThreads > 1 && m_blitter.isValid()) {
+        m_blitPool.reset(new QThreadPool);
+        m_blitPool->setMaxThreadCount(m_blitThreads - 1);
+        m_blitPool->setExpiryTimeout(-1);
+    }
+
+    if (asyncPresent) {
+        if (m_blitter.isValid())
+            m_presenter.reset(new QBsdFbPresenter(this, mGeometry.size(), mScreenImage->format(), m_arena.data()));
+        else
+            qWarning("bsdfb: Asynchronous presentation needs a blit kernel, presenting synchronously");
+    }
 
-    mCursor = new QFbCursor(this);
+    if (cursorPlane && !m_blitter.isValid()) {
+        qWarning("bsdfb: The cursor plane needs a blit kernel, composing the cursor");
+        cursorPlane = false;
+    }
+
+    if (cursorPlane)
+        m_cursor.reset(new QBsdFbCursor(this));
+    else
+        mCursor = new QFbCursor(this);
+
+    if (m_arena) {
+        qCDebug(qLcBsdFb, "Shadow buffers: %zu KiB in an aligned arena, %d bytes per line, huge pages %s, %s",
+                m_arena->size() >> 10, mScreenImage->bytesPerLine(), m_arena->hugePageMode(),
+                m_arena->prefaults() ? "prefaulted" : "faulted on demand");
+    } else {
+        qCDebug(qLcBsdFb, "Shadow buffers: heap, %d bytes per line", mScreenImage->bytesPerLine());
+    }
+    qCDebug(qLcBsdFb, "Framebuffer mapping %s", prefault ? "prefaulted" : "faulted on demand");
 
     return true;
 }
 
+// A window can be scanned out when it is the only visible one, covers the
+// whole screen, is opaque and needs no conversion beyond the blitter's.
+QBsdFbBackingStore *QBsdFbScreen::scanoutCandidate() const
+{
+    if (m_scanoutMode == ScanoutShadow && !m_blitter.isValid())
+        return nullptr;
+
+    if (mCursor && (mCursor->isOnScreen() || mCursor->isDirty()))
+        return nullptr;
+
+    // The window would paint over the cursor plane
+    if (m_cursor && m_cursor->isVisible() && m_scanoutMode == ScanoutDirect)
+        return nullptr;
+
+    QFbWindow *candidate = nullptr;
+    for (QFbWindow *window : mWindowStack) {
+        if (!window->window()->isVisible())
+            continue;
+        if (candidate)
+            return nullptr;
+        candidate = window;
+    }
+
+    if (!candidate || candidate->geometry() != mGeometry || candidate->window()->format().hasAlpha())
+        return nullptr;
+
+    QFbBackingStore *store = candidate->backingStore();
+    if (!store)
+        return nullptr;
+
+    const QImage image = store->image();
+    if (image.size() != mGeometry.size() || image.hasAlphaChannel())
+        return nullptr;
+
+    const QImage::Format required = m_scanoutMode == ScanoutDirect ? mFormat : mScreenImage->format();
+    if (image.format() != required)
+        return nullptr;
+
+    return static_cast<QBsdFbBackingStore *>(store);
+}
+
+void QBsdFbScreen::updateScanout()
+{
+    QBsdFbBackingStore *candidate = scanoutCandidate();
+    if (candidate == m_scanoutStore)
+        return;
+
+    if (m_scanoutStore)
+        releaseScanout(m_scanoutStore);
+
+    if (candidate) {
+        m_scanoutStore = candidate;
+        if (m_scanoutMode == ScanoutDirect) {
+            // The window is about to paint into the framebuffer itself
+            if (m_presenter)
+                m_presenter->waitForIdle();
+            // The hashes stop describing the framebuffer from here on
+            if (m_tileCache)
+                m_tileCache->invalidate();
+            candidate->attachToScreen(this, m_mmap.data, m_bytesPerLine);
+        } else {
+            candidate->attachToScreen(this);
+        }
+        mRepaintRegion += QRect(QPoint(0, 0), mGeometry.size());
+    }
+}
+
+void QBsdFbScreen::releaseScanout(QBsdFbBackingStore *store)
+{
+    if (store != m_scanoutStore)
+        return;
+
+    m_scanoutStore->detachFromScreen();
+    m_scanoutStore = nullptr;
+
+    // A window scanned out directly painted past the tile cache
+    if (m_tileCache && m_scanoutMode == ScanoutDirect)
+        m_tileCache->invalidate();
+
+    // The compositor has not seen any of the frames presented meanwhile
+    mRepaintRegion += QRect(QPoint(0, 0), mGeometry.size());
+    scheduleUpdate();
+}
+
+QPlatformCursor *QBsdFbScreen::cursor() const
+{
+    if (m_cursor)
+        return m_cursor.data();
+    return mCursor;
+}
+
+QList<QPlatformScreen *> QBsdFbScreen::virtualSiblings() const
+{
+    if (m_siblings.isEmpty())
+        return QFbScreen::virtualSiblings();
+    return m_siblings;
+}
+
+void QBsdFbScreen::setDirty(const QRect &rect)
+{
+    if (Q_UNLIKELY(QBsdFbTracer::instance()) && m_damageStart < 0)
+        m_damageStart = QBsdFbTracer::instance()->now();
+
+    QFbScreen::setDirty(rect);
+}
+
 QRegion QBsdFbScreen::doRedraw()
 {
-    const QRegion touched = QFbScreen::doRedraw();
+    // Time from the first damage to the redraw that consumes it
+    if (Q_UNLIKELY(QBsdFbTracer::instance()) && m_damageStart >= 0) {
+        QBsdFbTracer *tracer = QBsdFbTracer::instance();
+        tracer->record("damage", m_damageStart, tracer->now());
+        m_damageStart = -1;
+    }
+
+    if (Q_UNLIKELY(m_frameStats)) {
+        const qint64 start = m_frameStats->now();
+        const QRegion touched = redrawFrame();
+        if (!touched.isEmpty())
+            m_frameStats->recordFrame(start, m_frameStats->now(), !m_presenter);
+        return touched;
+    }
+
+    return redrawFrame();
+}
 
-    if (touched.isEmpty())
+QRegion QBsdFbScreen::redrawFrame()
+{
+    if (m_scanoutMode != ScanoutOff)
+        updateScanout();
+
+    if (m_scanoutStore) {
+        const QRegion touched = mRepaintRegion & QRect(QPoint(0, 0), mGeometry.size());
+        mRepaintRegion = QRegion();
+
+        // In direct mode the window has already painted into the framebuffer
+        if (m_scanoutMode == ScanoutShadow) {
+            m_scanoutStore->lock();
+            submit(m_scanoutStore->image(), touched);
+            m_scanoutStore->unlock();
+        } else if (!touched.isEmpty()) {
+            if (m_mirror)
+                m_mirror->publish(m_scanoutStore->image(), touched);
+            if (Q_UNLIKELY(QBsdFbStartup::instance()))
+                QBsdFbStartup::instance()->firstFrame();
+        }
         return touched;
+    }
 
-    if (!m_blitter)
-        m_blitter.reset(new QPainter(&m_onscreenImage));
+    QRegion touched;
+    {
+        QBsdFbTraceSpan span("compose");
+        touched = compose();
+    }
 
-    const auto rects = touched.rects();
-    for (const QRect &rect : rects)
-        m_blitter->drawImage(rect, *mScreenImage, rect);
+    submit(*mScreenImage, touched & mScreenImage->rect());
     return touched;
 }
 
-// grabWindow() grabs "from the screen" not from the backingstores.
+// Replaces QFbScreen's composition, which paints every window bottom to top
+// for each repainted rect. Windows are composed with CompositionMode_Source
+// there, so each pixel ends up coming from the topmost window covering it.
+// Walking the stack from the top and removing what each window covers
+// gives the same image while painting every pixel at most once.
+QRegion QBsdFbScreen::compose()
+{
+    if (mCursor && mCursor->isDirty() && mCursor->isOnScreen())
+        mRepaintRegion += mCursor->dirtyRect();
+    if (mRepaintRegion.isEmpty() && (!mCursor || !mCursor->isDirty()))
+        return QRegion();
+
+    if (!m_composePainter)
+        m_composePainter.reset(new QPainter(mScreenImage));
+    QPainter *painter = m_composePainter.data();
+    painter->setCompositionMode(QPainter::CompositionMode_Source);
+
+    const QPoint screenOffset = mGeometry.topLeft();
+    QRegion remaining = mRepaintRegion & QRect(QPoint(0, 0), mGeometry.size());
+
+    for (QFbWindow *window : qAsConst(mWindowStack)) {
+        if (remaining.isEmpty())
+            break;
+        if (!window->window()->isVisible())
+            continue;
+
+        QFbBackingStore *backingStore = window->backingStore();
+        if (!backingStore)
+            continue;
+
+        backingStore->lock();
+        const QImage image = backingStore->image();
+
+        // A backing store lagging behind a resize leaves the rest of the
+        // window to the windows below
+        const QRect windowRect = window->geometry().translated(-screenOffset);
+        const QRect covered = windowRect & QRect(windowRect.topLeft(), image.size());
+        const QRegion visible = remaining & covered;
+
+        if (!visible.isEmpty()) {
+            const auto rects = visible.rects();
+            for (const QRect &rect : rects)
+                painter->drawImage(rect, image, rect.translated(-windowRect.topLeft()));
+            remaining -= covered;
+        }
+        backingStore->unlock();
+    }
+
+    // Not covered by any window
+    const auto background = remaining.rects();
+    for (const QRect &rect : background)
+        painter->fillRect(rect, mScreenImage->hasAlphaChannel() ? Qt::transparent : Qt::black);
+
+    QRegion touched;
+    if (mCursor && (mCursor->isDirty() || mRepaintRegion.intersects(mCursor->lastPainted()))) {
+        // Nested in the compose span, so that the two can be told apart
+        QBsdFbTraceSpan span("drawCursor");
+        painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
+        touched += mCursor->drawCursor(*painter);
+    }
+    touched += mRepaintRegion;
+    mRepaintRegion = QRegion();
+
+    return touched;
+}
+
+// Limits redraws to the configured frame rate. While a frame is pending
+// mUpdatePending stays set, so damage arriving meanwhile only grows
+// mRepaintRegion; the first update after an idle period is drawn at once
+// and nothing ticks while the screen is clean.
+bool QBsdFbScreen::event(QEvent *event)
+{
+    if (event->type() == QEvent::UpdateRequest && m_frameInterval > 0) {
+        const qint64 remaining = m_lastFrameTime + m_frameInterval - m_frameClock.nsecsElapsed();
+        if (remaining <= 0)
+            redraw();
+        else if (!m_frameTimer.isActive())
+            m_frameTimer.start(int((remaining + 999999) / 1000000), Qt::PreciseTimer, this);
+        return true;
+    }
+
+    return QFbScreen::event(event);
+}
+
+void QBsdFbScreen::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_frameTimer.timerId()) {
+        m_frameTimer.stop();
+        redraw();
+        return;
+    }
+
+    QFbScreen::timerEvent(event);
+}
+
+void QBsdFbScreen::redraw()
+{
+    m_lastFrameTime = m_frameClock.nsecsElapsed();
+    doRedraw();
+    mUpdatePending = false;
+}
+
+// source holds the complete frame here, which the tile cache relies on
+void QBsdFbScreen::submit(const QImage &source, const QRegion &region)
+{
+    const QRegion changed = m_tileCache ? m_tileCache->changedRegion(source, region) : region;
+    // The cursor plane is redrawn while presenting, even without damage
+    const bool cursorChanged = m_cursor && m_cursor->takeChanged();
+    if (changed.isEmpty() && !cursorChanged)
+        return;
+
+    if (m_mirror && !changed.isEmpty())
+        m_mirror->publish(source, changed);
+
+    if (m_presenter)
+        m_presenter->queue(source, changed);
+    else
+        present(source, changed);
+}
+
+namespace {
+class BlitTask : public QRunnable
+{
+public:
+    BlitTask(const QBsdFbBlitter &blitter, uchar *target, int bytesPerLine,
+             const QImage &source, const QVector<QRect> &rects, int slot, QSemaphore *done)
+        : m_blitter(blitter), m_target(target), m_bytesPerLine(bytesPerLine),
+          m_source(source), m_rects(rects), m_slot(slot), m_done(done)
+    {
+    }
+
+    void run() override
+    {
+        QBsdFbTraceSpan span("blit", m_rects.size());
+        for (const QRect &rect : qAsConst(m_rects))
+            m_blitter.blit(m_target, m_bytesPerLine, m_source, rect, m_slot);
+        m_done->release();
+    }
+
+private:
+    const QBsdFbBlitter &m_blitter;
+    uchar *m_target;
+    int m_bytesPerLine;
+    const QImage &m_source;
+    QVector<QRect> m_rects;
+    int m_slot;
+    QSemaphore *m_done;
+};
+}
+
+static QVector<QRect> clippedRects(const QVector<QRect> &rects, const QRect &clip)
+{
+    QVector<QRect> result;
+    result.reserve(rects.size());
+    for (const QRect &rect : rects) {
+        const QRect r = rect & clip;
+        if (!r.isEmpty())
+            result.append(r);
+    }
+    return result;
+}
+
+// Splits the rects into horizontal bands, one per blit thread. Merged rects
+// may overlap, but bands never share rows, so no pixel is written twice
+// concurrently. Each band uses its own blitter slot for scaled rows.
+void QBsdFbScreen::blitParallel(uchar *target, const QImage &source, const QVector<QRect> &rects, const QRect &bounds)
+{
+    const int bands = qMin(m_blitThreads, bounds.height());
+    QSemaphore done;
+
+    for (int i = 1; i < bands; ++i) {
+        const int top = bounds.top() + bounds.height() * i / bands;
+        const int bottom = bounds.top() + bounds.height() * (i + 1) / bands;
+        const QRect band(bounds.left(), top, bounds.width(), bottom - top);
+        m_blitPool->start(new BlitTask(m_blitter, target, m_bytesPerLine, source,
+                                       clippedRects(rects, band), i, &done));
+    }
+
+    const int bottom = bounds.top() + bounds.height() / bands;
+    const QRect band(bounds.left(), bounds.top(), bounds.width(), bottom - bounds.top());
+    const QVector<QRect> own = clippedRects(rects, band);
+    {
+        QBsdFbTraceSpan span("blit", own.size());
+        for (const QRect &rect : own)
+            m_blitter.blit(target, m_bytesPerLine, source, rect);
+    }
+
+    done.acquire(bands - 1);
+}
+
+// Called on the presenter thread when presenting asynchronously
+void QBsdFbScreen::present(const QImage &source, const QRegion &region)
+{
+    if (Q_UNLIKELY(m_frameStats)) {
+        const qint64 start = m_frameStats->now();
+        int rects = 0;
+        const qint64 pixels = presentFrame(source, region, &rects);
+        m_frameStats->addBlit(m_frameStats->now() - start, rects, pixels);
+    } else {
+        int rects;
+        presentFrame(source, region, &rects);
+    }
+
+    if (Q_UNLIKELY(QBsdFbStartup::instance()))
+        QBsdFbStartup::instance()->firstFrame();
+}
+
+// Returns the number of pixels written
+qint64 QBsdFbScreen::presentFrame(const QImage &source, const QRegion &region, int *rectCount)
+{
+    if (!m_blitter.isValid()) {
+        if (!m_fallbackPainter) {
+            m_fallbackPainter.reset(new QPainter(&m_onscreenImage));
+            if (m_rotation) {
+                // Maps the logical screen onto the framebuffer, clockwise
+                const int width = m_onscreenImage.width();
+                const int height = m_onscreenImage.height();
+                if (m_rotation == 90)
+                    m_fallbackPainter->translate(width, 0);
+                else if (m_rotation == 180)
+                    m_fallbackPainter->translate(width, height);
+                else
+                    m_fallbackPainter->translate(0, height);
+                m_fallbackPainter->rotate(m_rotation);
+            }
+            m_fallbackPainter->scale(m_scale, m_scale);
+        }
+
+        qint64 area = 0;
+        const auto rects = region.rects();
+        for (const QRect &rect : rects) {
+            m_fallbackPainter->drawImage(rect, source, rect);
+            area += qint64(rect.width()) * rect.height();
+        }
+        *rectCount = rects.size();
+        return area;
+    }
+
+    // The back page missed the previous frame, so it gets that damage too
+    uchar *target = m_mmap.data;
+    QRegion damage = region;
+    int back = 0;
+    if (m_pageCount > 1) {
+        back = 1 - m_frontPage.load();
+        target = pageData(back);
+        damage += m_flipCarry;
+        m_flipCarry = region;
+    }
+
+    // Restore what the cursor covered on this page when it moved or changed
+    QImage cursorImage;
+    QRect cursorRect;
+    if (m_cursor) {
+        m_cursor->state(&cursorImage, &cursorRect);
+        const qint64 cursorKey = cursorImage.cacheKey();
+        if (cursorRect != m_cursorStamped[back] || cursorKey != m_cursorStampedKey[back]) {
+            damage += m_cursorStamped[back] & source.rect();
+            damage += cursorRect & source.rect();
+            m_cursorStamped[back] = cursorRect;
+            m_cursorStampedKey[back] = cursorKey;
+        }
+    }
+
+    const QVector<QRect> rects = m_damageOptimizer.optimize(damage);
+
+    qint64 area = 0;
+    for (const QRect &rect : rects)
+        area += qint64(rect.width()) * rect.height();
+
+    if (m_blitPool && area >= ParallelBlitThreshold) {
+        blitParallel(target, source, rects, damage.boundingRect());
+    } else {
+        for (const QRect &rect : rects) {
+            QBsdFbTraceSpan span("blit", 1);
+            m_blitter.blit(target, m_bytesPerLine, source, rect);
+        }
+    }
+
+    // Merged rects can cover the cursor even where the damage does not
+    if (!cursorRect.isEmpty()) {
+        for (const QRect &rect : rects) {
+            if (rect.intersects(cursorRect)) {
+                stampCursor(target, source, cursorImage, cursorRect);
+                break;
+            }
+        }
+    }
+
+    if (m_pageCount > 1) {
+        m_device->setDisplayStart(0, back * m_device->size().height());
+        m_frontPage.storeRelease(back);
+    }
+
+    *rectCount = rects.size();
+    return area;
+}
+
+// Blends the cursor over a copy of the frame underneath and writes the
+// result to the framebuffer, which is never read back
+void QBsdFbScreen::stampCursor(uchar *target, const QImage &source, const QImage &cursor, const QRect &rect)
+{
+    QBsdFbTraceSpan span("cursor");
+
+    const QRect clipped = rect & source.rect();
+    if (clipped.isEmpty())
+        return;
+
+    if (m_cursorScratch.size() != clipped.size() || m_cursorScratch.format() != source.format())
+        m_cursorScratch = QImage(clipped.size(), source.format());
+
+    const int bytesPerPixel = source.depth() / 8;
+    for (int y = 0; y < clipped.height(); ++y) {
+        memcpy(m_cursorScratch.scanLine(y), source.constScanLine(clipped.y() + y) + clipped.x() * bytesPerPixel,
+               clipped.width() * bytesPerPixel);
+    }
+
+    {
+        QPainter painter(&m_cursorScratch);
+        painter.drawImage(rect.topLeft() - clipped.topLeft(), cursor);
+    }
+
+    m_blitter.blit(target, m_bytesPerLine, m_cursorScratch, m_cursorScratch.rect(), clipped.topLeft());
+}
+
+// The last composed frame in cached memory. It matches the framebuffer
+// except for presents still in flight.
+QImage QBsdFbScreen::shadowImage() const
+{
+    if (m_scanoutStore)
+        return m_scanoutStore->image();
+    return *mScreenImage;
+}
+
+// Copies rect of the screen into image, which must already have the size
+// of rect. Nothing is allocated as long as image is not shared.
+bool QBsdFbScreen::grabInto(const QRect &rect, QImage *image) const
+{
+    QBsdFbTraceSpan span("grabWindow");
+
+    const QImage source = shadowImage();
+    if (!source.rect().contains(rect) || image->size() != rect.size())
+        return false;
+
+    if (image->format() == source.format()) {
+        const int bytes = rect.width() * source.depth() / 8;
+        const int offset = rect.x() * source.depth() / 8;
+        for (int y = 0; y < rect.height(); ++y)
+            memcpy(image->scanLine(y), source.constScanLine(rect.y() + y) + offset, bytes);
+    } else {
+        QPainter painter(image);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.drawImage(QPoint(0, 0), source, rect);
+    }
+    return true;
+}
+
+// grabWindow() grabs "from the screen" not from the backingstores. Only the
+// requested rect is copied, and from the shadow rather than the framebuffer.
 QPixmap QBsdFbScreen::grabWindow(WId wid, int x, int y, int width, int height) const
 {
+    QBsdFbTraceSpan span("grabWindow");
+
+    const QImage image = shadowImage();
+    QRect rect;
     if (!wid) {
         if (width < 0)
-            width = m_onscreenImage.width() - x;
+            width = image.width() - x;
         if (height < 0)
-            height = m_onscreenImage.height() - y;
-        return QPixmap::fromImage(m_onscreenImage).copy(x, y, width, height);
-    }
+            height = image.height() - y;
+        rect = QRect(x, y, width, height) & image.rect();
+    } else {
+        const QFbWindow *window = windowForId(wid);
+        if (!window)
+            return QPixmap();
 
-    const QFbWindow *window = windowForId(wid);
-    if (window) {
-        const QRect geom = window->geometry();
+        // Window geometry is in virtual desktop coordinates
+        const QRect geom = window->geometry().translated(-mGeometry.topLeft());
         if (width < 0)
             width = geom.width() - x;
         if (height < 0)
             height = geom.height() - y;
-        QRect rect(geom.topLeft() + QPoint(x, y), QSize(width, height));
-        rect &= window->geometry();
-        return QPixmap::fromImage(m_onscreenImage).copy(rect);
+        rect = QRect(geom.topLeft() + QPoint(x, y), QSize(width, height));
+        rect &= geom;
+        rect &= image.rect();
     }
 
-    return QPixmap();
+    if (rect.isEmpty())
+        return QPixmap();
+    return QPixmap::fromImage(image.copy(rect));
 }
 
 QT_END_NAMESPACE
@@ -35,11 +35,28 @@
 #ifndef QBSDFBSCREEN_H
 #define QBSDFBSCREEN_H
 
+#include "qbsdfbblitter.h"
+#include "qbsdfbdamage.h"
+
 #include <QtPlatformSupport/private/qfbscreen_p.h>
+#include <QtCore/QBasicTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QLoggingCategory>
 
 QT_BEGIN_NAMESPACE
 
+Q_DECLARE_LOGGING_CATEGORY(qLcBsdFb)
+
 class QPainter;
+class QThreadPool;
+class QBsdFbDevice;
+class QBsdFbBackingStore;
+class QBsdFbPresenter;
+class QBsdFbTileCache;
+class QBsdFbFrameStats;
+class QBsdFbMirror;
+class QBsdFbCursor;
+class QBsdFbArena;
 
 class QBsdFbScreen : public QFbScreen
 {
@@ -51,22 +68,98 @@ public:
     bool initialize();
 
     QPixmap grabWindow(WId wid, int x, int y, int width, int height) const override;
+    bool grabInto(const QRect &rect, QImage *image) const;
 
+    void setDirty(const QRect &rect) override;
     QRegion doRedraw() override;
+    QPlatformCursor *cursor() const override;
+    QBsdFbCursor *planeCursor() const { return m_cursor.data(); }
+
+    QList<QPlatformScreen *> virtualSiblings() const override;
+    void setVirtualSiblings(const QList<QPlatformScreen *> &siblings) { m_siblings = siblings; }
+    void setVirtualPosition(const QPoint &pos) { mGeometry.moveTopLeft(pos); }
+
+    void updateCursor() { scheduleUpdate(); }
+
+    void releaseScanout(QBsdFbBackingStore *store);
+
+    void present(const QImage &source, const QRegion &region);
+
+    const QBsdFbTileCache *tileCache() const { return m_tileCache.data(); }
+    QBsdFbFrameStats *frameStats() const { return m_frameStats.data(); }
+
+protected:
+    bool event(QEvent *event) override;
+    void timerEvent(QTimerEvent *event) override;
 
 private:
+    enum ScanoutMode {
+        ScanoutOff,
+        ScanoutShadow,
+        ScanoutDirect
+    };
+
+    QBsdFbBackingStore *scanoutCandidate() const;
+    void updateScanout();
+    QRegion redrawFrame();
+    qint64 presentFrame(const QImage &source, const QRegion &region, int *rectCount);
+    void submit(const QImage &source, const QRegion &region);
+    void stampCursor(uchar *target, const QImage &source, const QImage &cursor, const QRect &rect);
+    void blitParallel(uchar *target, const QImage &source, const QVector<QRect> &rects, const QRect &bounds);
+    uchar *pageData(int page) const { return m_mmap.data + page * m_pageBytes; }
+    QImage shadowImage() const;
+    QRegion compose();
+    void redraw();
+
     QStringList m_arguments;
-    int m_framebufferFd = -1;
+    QList<QPlatformScreen *> m_siblings;
+    QScopedPointer<QBsdFbDevice> m_device;
+    // Declared before everything that may hold its images
+    QScopedPointer<QBsdFbArena> m_arena;
+    // Null unless windows can paint straight into the framebuffer
     QImage m_onscreenImage;
+    bool m_nativeFormat = false;
 
     int m_bytesPerLine = -1;
 
     struct {
         uchar *data;
-        int offset, size;
+        int offset;
     } m_mmap;
 
-    QScopedPointer<QPainter> m_blitter;
+    qint64 m_frameInterval = 0;
+    qint64 m_lastFrameTime = 0;
+    QElapsedTimer m_frameClock;
+    QBasicTimer m_frameTimer;
+
+    int m_rotation = 0;
+    int m_scale = 1;
+
+    int m_pageCount = 1;
+    int m_pageBytes = 0;
+    QAtomicInt m_frontPage;
+    QRegion m_flipCarry;
+
+    ScanoutMode m_scanoutMode = ScanoutOff;
+    QBsdFbBackingStore *m_scanoutStore = nullptr;
+
+    QBsdFbBlitter m_blitter;
+    QBsdFbDamageOptimizer m_damageOptimizer;
+    QScopedPointer<QPainter> m_fallbackPainter;
+    QScopedPointer<QPainter> m_composePainter;
+    QScopedPointer<QBsdFbPresenter> m_presenter;
+    QScopedPointer<QThreadPool> m_blitPool;
+    QScopedPointer<QBsdFbTileCache> m_tileCache;
+    QScopedPointer<QBsdFbFrameStats> m_frameStats;
+    QScopedPointer<QBsdFbMirror> m_mirror;
+
+    // Owned by whichever thread presents
+    QScopedPointer<QBsdFbCursor> m_cursor;
+    QImage m_cursorScratch;
+    QRect m_cursorStamped[2];
+    qint64 m_cursorStampedKey[2] = { 0, 0 };
+    qint64 m_damageStart = -1;
+    int m_blitThreads = 1;
 };
 
 QT_END_NAMESPACE
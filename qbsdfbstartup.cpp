@@ -0,0 +1,90 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbstartup.h"
+
+#include <stdio.h>
+
+QT_BEGIN_NAMESPACE
+
+QBsdFbStartup *QBsdFbStartup::s_instance = nullptr;
+
+QBsdFbStartup::QBsdFbStartup()
+{
+    m_clock.start();
+    s_instance = this;
+}
+
+QBsdFbStartup::~QBsdFbStartup()
+{
+    s_instance = nullptr;
+}
+
+void QBsdFbStartup::record(const char *name, qint64 start, qint64 end)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_presented.load()) {
+        fprintf(stderr, "bsdfb: startup: %-16s %8.1f ms +%8.1f ms (after first frame)\n",
+                name, start / 1e6, (end - start) / 1e6);
+        return;
+    }
+
+    m_phases.append({ name, start, end });
+}
+
+void QBsdFbStartup::firstFrame()
+{
+    if (m_presented.loadAcquire())
+        return;
+
+    QMutexLocker lock(&m_mutex);
+    if (m_presented.load())
+        return;
+    m_presented.storeRelease(1);
+
+    const qint64 end = now();
+    qint64 covered = 0;
+    fprintf(stderr, "bsdfb: startup: first frame after %.1f ms\n", end / 1e6);
+    for (const Phase &phase : qAsConst(m_phases)) {
+        fprintf(stderr, "bsdfb: startup: %-16s %8.1f ms +%8.1f ms\n",
+                phase.name, phase.start / 1e6, (phase.end - phase.start) / 1e6);
+        covered += phase.end - phase.start;
+    }
+    // Time spent outside the plugin, in the application and in Qt
+    fprintf(stderr, "bsdfb: startup: %-16s             +%8.1f ms\n",
+            "other", qMax<qint64>(0, end - covered) / 1e6);
+    m_phases.clear();
+}
+
+QT_END_NAMESPACE
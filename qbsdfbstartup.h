@@ -0,0 +1,105 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBSTARTUP_H
+#define QBSDFBSTARTUP_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+
+QT_BEGIN_NAMESPACE
+
+// Breaks down the time from creating the platform plugin to the first
+// frame reaching the framebuffer and prints it to stderr once that frame
+// is presented. Enabled with QT_QPA_BSDFB_STARTUP=1. Phases may be
+// recorded on any thread; those ending after the first frame are printed
+// as they finish.
+class QBsdFbStartup
+{
+public:
+    QBsdFbStartup();
+    ~QBsdFbStartup();
+
+    static QBsdFbStartup *instance() { return s_instance; }
+
+    qint64 now() const { return m_clock.nsecsElapsed(); }
+
+    // name must be a string literal, only the pointer is stored
+    void record(const char *name, qint64 start, qint64 end);
+    void firstFrame();
+
+private:
+    struct Phase {
+        const char *name;
+        qint64 start;
+        qint64 end;
+    };
+
+    static QBsdFbStartup *s_instance;
+
+    QElapsedTimer m_clock;
+    QMutex m_mutex;
+    QVector<Phase> m_phases;
+    QAtomicInt m_presented;
+};
+
+class QBsdFbStartupPhase
+{
+public:
+    explicit QBsdFbStartupPhase(const char *name)
+        : m_startup(QBsdFbStartup::instance()), m_name(name)
+    {
+        if (Q_UNLIKELY(m_startup))
+            m_start = m_startup->now();
+    }
+
+    ~QBsdFbStartupPhase()
+    {
+        if (Q_UNLIKELY(m_startup))
+            m_startup->record(m_name, m_start, m_startup->now());
+    }
+
+private:
+    Q_DISABLE_COPY(QBsdFbStartupPhase)
+
+    QBsdFbStartup *m_startup;
+    const char *m_name;
+    qint64 m_start = 0;
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBSTARTUP_H
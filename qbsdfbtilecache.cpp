@@ -0,0 +1,144 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbtilecache.h"
+
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+QBsdFbTileCache::QBsdFbTileCache(const QSize &screenSize, int tileSize)
+    : m_tileSize(tileSize),
+      m_columns((screenSize.width() + tileSize - 1) / tileSize),
+      m_rows((screenSize.height() + tileSize - 1) / tileSize),
+      m_screenSize(screenSize),
+      m_hashes(m_columns * m_rows),
+      m_valid(m_columns * m_rows, false),
+      m_touched(m_columns * m_rows, false)
+{
+    m_stats.tilesChecked = 0;
+    m_stats.tilesUnchanged = 0;
+}
+
+static inline quint64 mix(quint64 h, quint64 v)
+{
+    h ^= v;
+    h *= Q_UINT64_C(0x9e3779b97f4a7c15);
+    return h ^ (h >> 29);
+}
+
+quint64 QBsdFbTileCache::hashTile(const QImage &source, const QRect &tile) const
+{
+    const int bytesPerPixel = source.depth() / 8;
+    const int rowBytes = tile.width() * bytesPerPixel;
+    quint64 h = Q_UINT64_C(0xcbf29ce484222325);
+
+    for (int y = tile.top(); y <= tile.bottom(); ++y) {
+        const uchar *p = source.constScanLine(y) + tile.x() * bytesPerPixel;
+        int i = 0;
+        for (; i + 8 <= rowBytes; i += 8) {
+            quint64 v;
+            memcpy(&v, p + i, sizeof(v));
+            h = mix(h, v);
+        }
+        if (i < rowBytes) {
+            quint64 v = 0;
+            memcpy(&v, p + i, rowBytes - i);
+            h = mix(h, v);
+        }
+    }
+
+    return h;
+}
+
+void QBsdFbTileCache::invalidate()
+{
+    m_valid.fill(false);
+}
+
+QRegion QBsdFbTileCache::changedRegion(const QImage &source, const QRegion &region)
+{
+    const QRect screen(QPoint(0, 0), m_screenSize);
+    const auto rects = (region & screen).rects();
+
+    int firstRow = m_rows;
+    int lastRow = -1;
+    for (const QRect &rect : rects) {
+        const int top = rect.top() / m_tileSize;
+        const int bottom = rect.bottom() / m_tileSize;
+        const int left = rect.left() / m_tileSize;
+        const int right = rect.right() / m_tileSize;
+        for (int row = top; row <= bottom; ++row) {
+            for (int column = left; column <= right; ++column)
+                m_touched[row * m_columns + column] = true;
+        }
+        firstRow = qMin(firstRow, top);
+        lastRow = qMax(lastRow, bottom);
+    }
+
+    // Runs of changed tiles in a row become one rect
+    QRegion changed;
+    for (int row = firstRow; row <= lastRow; ++row) {
+        int runStart = -1;
+        for (int column = 0; column <= m_columns; ++column) {
+            bool dirty = false;
+            const int index = row * m_columns + column;
+            if (column < m_columns && m_touched.at(index)) {
+                m_touched[index] = false;
+                const QRect tile = QRect(column * m_tileSize, row * m_tileSize, m_tileSize, m_tileSize) & screen;
+                const quint64 hash = hashTile(source, tile);
+                ++m_stats.tilesChecked;
+                if (m_valid.at(index) && m_hashes.at(index) == hash) {
+                    ++m_stats.tilesUnchanged;
+                } else {
+                    m_hashes[index] = hash;
+                    m_valid[index] = true;
+                    dirty = true;
+                }
+            }
+
+            if (dirty && runStart < 0) {
+                runStart = column;
+            } else if (!dirty && runStart >= 0) {
+                changed += QRect(runStart * m_tileSize, row * m_tileSize,
+                                 (column - runStart) * m_tileSize, m_tileSize);
+                runStart = -1;
+            }
+        }
+    }
+
+    return region & changed;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,81 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBTILECACHE_H
+#define QBSDFBTILECACHE_H
+
+#include <QtCore/QVector>
+#include <QtGui/QImage>
+#include <QtGui/QRegion>
+
+QT_BEGIN_NAMESPACE
+
+// Remembers a hash of every tile of the screen as it was last presented,
+// so damage over pixels that did not actually change is not written to the
+// framebuffer again. Must be fed the complete composed frame.
+class QBsdFbTileCache
+{
+public:
+    // Returned by the "tilecachestats" screen resource
+    struct Stats {
+        quint64 tilesChecked;
+        quint64 tilesUnchanged;
+    };
+
+    QBsdFbTileCache(const QSize &screenSize, int tileSize);
+
+    QRegion changedRegion(const QImage &source, const QRegion &region);
+    // Forgets every hash, for when the framebuffer was written behind the
+    // cache's back
+    void invalidate();
+
+    int tileSize() const { return m_tileSize; }
+    const Stats *stats() const { return &m_stats; }
+
+private:
+    quint64 hashTile(const QImage &source, const QRect &tile) const;
+
+    int m_tileSize;
+    int m_columns;
+    int m_rows;
+    QSize m_screenSize;
+    QVector<quint64> m_hashes;
+    QVector<bool> m_valid;
+    QVector<bool> m_touched;
+    Stats m_stats;
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBTILECACHE_H
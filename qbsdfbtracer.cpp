@@ -0,0 +1,191 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbtracer.h"
+#include "qbsdfbscreen.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QSocketNotifier>
+
+#include <atomic>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+QT_BEGIN_NAMESPACE
+
+QBsdFbTracer *QBsdFbTracer::s_instance = nullptr;
+
+static int signalFd[2] = { -1, -1 };
+
+static void signalHandler(int)
+{
+    const char c = 1;
+    ssize_t ret;
+    do {
+        ret = ::write(signalFd[0], &c, 1);
+    } while (ret < 0 && errno == EINTR);
+}
+
+QBsdFbTracer::QBsdFbTracer(const QString &fileName, int capacity)
+    : m_fileName(fileName),
+      m_events(new Event[capacity]),
+      m_capacity(capacity)
+{
+    for (int i = 0; i < m_capacity; ++i)
+        m_events[i].sequence.store(0);
+
+    m_clock.start();
+    s_instance = this;
+
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalFd)) {
+        qErrnoWarning(errno, "bsdfb: socketpair() failed, trace is only written on exit");
+        return;
+    }
+
+    m_signalNotifier = new QSocketNotifier(signalFd[1], QSocketNotifier::Read, this);
+    connect(m_signalNotifier, SIGNAL(activated(int)), this, SLOT(handleSignal()));
+
+    struct sigaction sa;
+    sa.sa_flags = SA_RESTART;
+    sa.sa_handler = signalHandler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR2, &sa, nullptr);
+}
+
+QBsdFbTracer::~QBsdFbTracer()
+{
+    if (m_signalNotifier) {
+        signal(SIGUSR2, SIG_DFL);
+        delete m_signalNotifier;
+        ::close(signalFd[0]);
+        ::close(signalFd[1]);
+        signalFd[0] = signalFd[1] = -1;
+    }
+
+    s_instance = nullptr;
+    write();
+}
+
+void QBsdFbTracer::record(const char *name, qint64 start, qint64 end, int arg)
+{
+    static thread_local int thread = 0;
+    if (Q_UNLIKELY(!thread))
+        thread = m_threads.fetchAndAddRelaxed(1) + 1;
+
+    const quint64 index = m_next.fetchAndAddRelaxed(1);
+    Event &event = m_events[int(index % m_capacity)];
+
+    // Claim the slot unless another thread is still filling it or a newer
+    // span already took it after the ring wrapped around
+    quint64 sequence;
+    do {
+        sequence = event.sequence.load();
+        if ((sequence & 1) || sequence > 2 * index) {
+            m_dropped.ref();
+            return;
+        }
+    } while (!event.sequence.testAndSetAcquire(sequence, 2 * index + 1));
+
+    event.name = name;
+    event.start = start;
+    event.duration = end - start;
+    event.thread = thread;
+    event.arg = arg;
+    event.sequence.storeRelease(2 * index + 2);
+}
+
+void QBsdFbTracer::handleSignal()
+{
+    m_signalNotifier->setEnabled(false);
+    char c;
+    ::read(signalFd[1], &c, 1);
+
+    if (write())
+        qCDebug(qLcBsdFb) << "Trace written to" << m_fileName;
+
+    m_signalNotifier->setEnabled(true);
+}
+
+bool QBsdFbTracer::write() const
+{
+    FILE *f = fopen(QFile::encodeName(m_fileName).constData(), "w");
+    if (!f) {
+        qErrnoWarning(errno, "bsdfb: Failed to write trace to %s", qPrintable(m_fileName));
+        return false;
+    }
+
+    const quint64 next = m_next.loadAcquire();
+    const quint64 first = next > quint64(m_capacity) ? next - m_capacity : 0;
+    const int pid = int(::getpid());
+    bool separator = false;
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    for (quint64 index = first; index < next; ++index) {
+        const Event &event = m_events[int(index % m_capacity)];
+        const quint64 committed = 2 * index + 2;
+        if (event.sequence.loadAcquire() != committed)
+            continue;
+
+        // Copy before checking the sequence again in case a writer
+        // claimed the slot meanwhile
+        const char *name = event.name;
+        const qint64 start = event.start;
+        const qint64 duration = event.duration;
+        const int thread = event.thread;
+        const int arg = event.arg;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (event.sequence.load() != committed)
+            continue;
+
+        fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"bsdfb\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                   "\"ts\":%.3f,\"dur\":%.3f",
+                separator ? ",\n" : "", name, pid, thread, start / 1000.0, duration / 1000.0);
+        if (arg >= 0)
+            fprintf(f, ",\"args\":{\"n\":%d}", arg);
+        fputc('}', f);
+        separator = true;
+    }
+    fputs("\n]}\n", f);
+
+    if (const int dropped = m_dropped.load())
+        qCDebug(qLcBsdFb) << "Dropped" << dropped << "trace spans whose slot was busy";
+
+    return fclose(f) == 0;
+}
+
+QT_END_NAMESPACE
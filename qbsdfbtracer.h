@@ -0,0 +1,130 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QBSDFBTRACER_H
+#define QBSDFBTRACER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QScopedArrayPointer>
+
+QT_BEGIN_NAMESPACE
+
+class QSocketNotifier;
+
+// Records timestamped spans into a preallocated ring and writes them in
+// Chrome trace-event format when destroyed or when the process receives
+// SIGUSR2. Enabled with QT_QPA_BSDFB_TRACE=<file>. Recording is lock-free
+// and may happen on any thread; once the ring is full the oldest spans
+// are overwritten. A slot is claimed through its sequence before it is
+// filled and only exported once committed, spans that find their slot
+// still being filled by another thread are dropped.
+class QBsdFbTracer : public QObject
+{
+    Q_OBJECT
+public:
+    enum {
+        DefaultCapacity = 65536
+    };
+
+    QBsdFbTracer(const QString &fileName, int capacity);
+    ~QBsdFbTracer() override;
+
+    static QBsdFbTracer *instance() { return s_instance; }
+
+    qint64 now() const { return m_clock.nsecsElapsed(); }
+
+    // name must be a string literal, only the pointer is stored
+    void record(const char *name, qint64 start, qint64 end, int arg = -1);
+
+    bool write() const;
+
+private slots:
+    void handleSignal();
+
+private:
+    // sequence is 2 * index + 1 while the span with that index is being
+    // written and 2 * index + 2 once it is committed
+    struct Event {
+        QAtomicInteger<quint64> sequence;
+        const char *name;
+        qint64 start;
+        qint64 duration;
+        int thread;
+        int arg;
+    };
+
+    static QBsdFbTracer *s_instance;
+
+    QString m_fileName;
+    QElapsedTimer m_clock;
+    QScopedArrayPointer<Event> m_events;
+    int m_capacity;
+    QAtomicInteger<quint64> m_next;
+    QAtomicInt m_dropped;
+    QAtomicInt m_threads;
+    QSocketNotifier *m_signalNotifier = nullptr;
+};
+
+class QBsdFbTraceSpan
+{
+public:
+    explicit QBsdFbTraceSpan(const char *name, int arg = -1)
+        : m_tracer(QBsdFbTracer::instance()), m_name(name), m_arg(arg)
+    {
+        if (Q_UNLIKELY(m_tracer))
+            m_start = m_tracer->now();
+    }
+
+    ~QBsdFbTraceSpan()
+    {
+        if (Q_UNLIKELY(m_tracer))
+            m_tracer->record(m_name, m_start, m_tracer->now(), m_arg);
+    }
+
+    void setArg(int arg) { m_arg = arg; }
+
+private:
+    Q_DISABLE_COPY(QBsdFbTraceSpan)
+
+    QBsdFbTracer *m_tracer;
+    const char *m_name;
+    qint64 m_start = 0;
+    int m_arg;
+};
+
+QT_END_NAMESPACE
+
+#endif // QBSDFBTRACER_H
@@ -0,0 +1,16 @@
+TARGET = tst_qbsdfbblitter
+
+QT = core-private gui-private testlib
+
+INCLUDEPATH += ../../..
+
+SOURCES = \
+    tst_qbsdfbblitter.cpp \
+    ../../../qbsdfbblitter.cpp \
+    ../../../qbsdfbarena.cpp \
+    ../../../qbsdfbdevice.cpp
+
+HEADERS = \
+    ../../../qbsdfbblitter.h \
+    ../../../qbsdfbarena.h \
+    ../../../qbsdfbdevice.h
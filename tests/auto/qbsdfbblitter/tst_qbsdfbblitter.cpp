@@ -0,0 +1,132 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbarena.h"
+#include "qbsdfbblitter.h"
+
+#include <QtCore/QByteArray>
+#include <QtTest/QtTest>
+
+Q_DECLARE_METATYPE(QBsdFbDevice::PixelLayout)
+
+enum {
+    Height = 16
+};
+
+// Channels already quantized to RGB565, so that every conversion agrees
+static void fillPattern(QImage *image)
+{
+    for (int y = 0; y < image->height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image->scanLine(y));
+        for (int x = 0; x < image->width(); ++x)
+            line[x] = qRgb((x * 8) & 0xf8, (y * 4) & 0xfc, ((x + y) * 8) & 0xf8);
+    }
+}
+
+class tst_QBsdFbBlitter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void defaultArena_data();
+    void defaultArena();
+    void columnAccessPadding();
+};
+
+void tst_QBsdFbBlitter::defaultArena_data()
+{
+    QTest::addColumn<int>("width");
+    QTest::addColumn<QBsdFbDevice::PixelLayout>("layout");
+    QTest::addColumn<int>("reference");
+    QTest::addColumn<bool>("singleSpan");
+
+    static const int widths[] = { 640, 1280, 1920 };
+    for (int width : widths) {
+        QTest::newRow(qPrintable(QStringLiteral("%1-xrgb8888").arg(width)))
+            << width << QBsdFbDevice::XRGB8888 << int(QImage::Format_RGB32) << true;
+        QTest::newRow(qPrintable(QStringLiteral("%1-rgb565").arg(width)))
+            << width << QBsdFbDevice::RGB565 << int(QImage::Format_RGB16) << true;
+    }
+    // Rows of 5464 bytes are padded to the next cache line
+    QTest::newRow("1366-xrgb8888") << 1366 << QBsdFbDevice::XRGB8888 << int(QImage::Format_RGB32) << false;
+}
+
+// The composed screen comes from an arena by default; full-width rects of
+// common widths have to reach the single span path from it
+void tst_QBsdFbBlitter::defaultArena()
+{
+    QFETCH(int, width);
+    QFETCH(QBsdFbDevice::PixelLayout, layout);
+    QFETCH(int, reference);
+    QFETCH(bool, singleSpan);
+
+    QBsdFbArena arena(false, false);
+    QImage source = arena.allocate(QSize(width, Height), QImage::Format_RGB32);
+    QVERIFY(!source.isNull());
+    fillPattern(&source);
+
+    QBsdFbBlitter blitter;
+    QVERIFY(blitter.setFormats(QImage::Format_RGB32, layout));
+
+    const int targetBytesPerLine = width * QBsdFbDevice::bytesPerPixel(layout);
+    QCOMPARE(blitter.isSingleSpan(width, source.bytesPerLine(), targetBytesPerLine), singleSpan);
+
+    QByteArray target(targetBytesPerLine * Height, 0);
+    blitter.blit(reinterpret_cast<uchar *>(target.data()), targetBytesPerLine, source, source.rect());
+
+    const QImage expected = source.convertToFormat(QImage::Format(reference));
+    for (int y = 0; y < Height; ++y) {
+        QCOMPARE(QByteArray::fromRawData(target.constData() + y * targetBytesPerLine, targetBytesPerLine),
+                 QByteArray::fromRawData(reinterpret_cast<const char *>(expected.constScanLine(y)),
+                                         targetBytesPerLine));
+    }
+}
+
+// Rotated screens read the image column by column and keep the padding
+// that spreads 1 KiB rows over the cache sets
+void tst_QBsdFbBlitter::columnAccessPadding()
+{
+    QCOMPARE(QBsdFbArena::paddedBytesPerLine(1280, QImage::Format_RGB32, false), 5120);
+    QCOMPARE(QBsdFbArena::paddedBytesPerLine(1280, QImage::Format_RGB32, true), 5120 + int(QBsdFbArena::CacheLineSize));
+    QCOMPARE(QBsdFbArena::paddedBytesPerLine(1366, QImage::Format_RGB32, false), 5504);
+
+    QBsdFbArena arena(false, false, true);
+    const QImage image = arena.allocate(QSize(256, Height), QImage::Format_RGB32);
+    QVERIFY(!image.isNull());
+    QCOMPARE(image.bytesPerLine(), 1024 + int(QBsdFbArena::CacheLineSize));
+}
+
+QTEST_GUILESS_MAIN(tst_QBsdFbBlitter)
+
+#include "tst_qbsdfbblitter.moc"
@@ -0,0 +1,11 @@
+TARGET = tst_qbsdfbinput
+
+QT = core-private gui-private platformsupport-private testlib
+
+INCLUDEPATH += ../../..
+
+SOURCES = \
+    tst_qbsdfbinput.cpp \
+    ../../../qbsdfbinput.cpp
+
+HEADERS = ../../../qbsdfbinput.h
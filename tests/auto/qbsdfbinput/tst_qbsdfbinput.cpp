@@ -0,0 +1,320 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbinput.h"
+
+#include <QtCore/QLoggingCategory>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QVector>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QScreen>
+#include <QtTest/QtTest>
+#include <QtGui/private/qguiapplication_p.h>
+#include <QtGui/private/qinputdevicemanager_p.h>
+#include <qpa/qwindowsysteminterface_p.h>
+
+#include <string.h>
+
+#ifndef QT_NO_EVDEV
+#ifdef Q_OS_FREEBSD
+#include <dev/evdev/input.h>
+#else
+#include <linux/input.h>
+#endif
+#endif
+
+QT_BEGIN_NAMESPACE
+Q_LOGGING_CATEGORY(qLcBsdFb, "qt.qpa.bsdfb")
+QT_END_NAMESPACE
+
+Q_DECLARE_METATYPE(QBsdFbPointerHandler::Protocol)
+
+// Raw device data as it is read from /dev/sysmouse at level 1 or from an
+// evdev node, one record or report per motion sample or button change
+class Recording
+{
+public:
+    explicit Recording(QBsdFbPointerHandler::Protocol protocol) : m_protocol(protocol) {}
+
+    void move(int dx, int dy);
+    void setLeftButton(bool pressed);
+
+    const QByteArray &data() const { return m_data; }
+
+private:
+    void appendPacket(int dx, int dy);
+    void appendEvent(int type, int code, int value);
+
+    QBsdFbPointerHandler::Protocol m_protocol;
+    bool m_pressed = false;
+    QByteArray m_data;
+};
+
+void Recording::move(int dx, int dy)
+{
+    if (m_protocol == QBsdFbPointerHandler::SysMouse) {
+        appendPacket(dx, dy);
+        return;
+    }
+#ifndef QT_NO_EVDEV
+    appendEvent(EV_REL, REL_X, dx);
+    appendEvent(EV_REL, REL_Y, dy);
+    appendEvent(EV_SYN, SYN_REPORT, 0);
+#endif
+}
+
+void Recording::setLeftButton(bool pressed)
+{
+    m_pressed = pressed;
+    if (m_protocol == QBsdFbPointerHandler::SysMouse) {
+        appendPacket(0, 0);
+        return;
+    }
+#ifndef QT_NO_EVDEV
+    appendEvent(EV_KEY, BTN_LEFT, pressed);
+    appendEvent(EV_SYN, SYN_REPORT, 0);
+#endif
+}
+
+// Buttons are active low and y grows upwards
+void Recording::appendPacket(int dx, int dy)
+{
+    const char packet[8] = {
+        char(0x80 | (m_pressed ? 0x03 : 0x07)),
+        char(dx), char(-dy), 0, 0, 0, 0, 0x7f
+    };
+    m_data.append(packet, sizeof(packet));
+}
+
+void Recording::appendEvent(int type, int code, int value)
+{
+#ifndef QT_NO_EVDEV
+    input_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    m_data.append(reinterpret_cast<const char *>(&event), sizeof(event));
+#else
+    Q_UNUSED(type);
+    Q_UNUSED(code);
+    Q_UNUSED(value);
+#endif
+}
+
+struct MouseEvent
+{
+    QPoint pos;
+    Qt::MouseButtons buttons;
+};
+
+// Takes the mouse events the handler queued, without delivering them
+static QVector<MouseEvent> takeMouseEvents()
+{
+    QVector<MouseEvent> events;
+    while (QWindowSystemInterfacePrivate::windowSystemEventsQueued()) {
+        QWindowSystemInterfacePrivate::WindowSystemEvent *event = QWindowSystemInterfacePrivate::getWindowSystemEvent();
+        if (event->type == QWindowSystemInterfacePrivate::Mouse) {
+            const QWindowSystemInterfacePrivate::MouseEvent *mouse =
+                    static_cast<QWindowSystemInterfacePrivate::MouseEvent *>(event);
+            events.append({ mouse->globalPos.toPoint(), mouse->buttons });
+        }
+        delete event;
+    }
+    return events;
+}
+
+class tst_QBsdFbInput : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+
+    void coalesceBatch_data() { protocols(); }
+    void coalesceBatch();
+    void buttonAfterPendingMove_data() { protocols(); }
+    void buttonAfterPendingMove();
+    void sharedPosition_data() { protocols(); }
+    void sharedPosition();
+    void replay_data() { protocols(); }
+    void replay();
+
+private:
+    void protocols();
+    void centerPointer();
+
+    QPoint m_center;
+};
+
+void tst_QBsdFbInput::protocols()
+{
+    QTest::addColumn<QBsdFbPointerHandler::Protocol>("protocol");
+
+    QTest::newRow("sysmouse") << QBsdFbPointerHandler::SysMouse;
+#ifndef QT_NO_EVDEV
+    QTest::newRow("evdev") << QBsdFbPointerHandler::Evdev;
+#endif
+}
+
+void tst_QBsdFbInput::init()
+{
+    QVERIFY(QGuiApplication::primaryScreen());
+    m_center = QGuiApplication::primaryScreen()->virtualGeometry().center();
+    takeMouseEvents();
+}
+
+// The pointer position is shared by all handlers and outlives them; this
+// moves it the way QCursor::setPos() does, once a handler listens
+void tst_QBsdFbInput::centerPointer()
+{
+    QGuiApplicationPrivate::inputDeviceManager()->setCursorPos(m_center);
+}
+
+void tst_QBsdFbInput::coalesceBatch()
+{
+    QFETCH(QBsdFbPointerHandler::Protocol, protocol);
+
+    Recording recording(protocol);
+    for (int i = 0; i < 100; ++i)
+        recording.move(1, 2);
+
+    QBsdFbPointerHandler handler(protocol);
+    centerPointer();
+    handler.feed(reinterpret_cast<const uchar *>(recording.data().constData()), recording.data().size());
+
+    QCOMPARE(handler.samples(), 100);
+    QCOMPARE(handler.moves(), 1);
+
+    const QVector<MouseEvent> events = takeMouseEvents();
+    QCOMPARE(events.size(), 1);
+    QCOMPARE(events.at(0).pos, m_center + QPoint(100, 200));
+    QCOMPARE(events.at(0).buttons, Qt::MouseButtons(Qt::NoButton));
+}
+
+// A press or release is sent where the pointer is, so the motion before it
+// in the same batch has to be sent first instead of waiting for the frame
+void tst_QBsdFbInput::buttonAfterPendingMove()
+{
+    QFETCH(QBsdFbPointerHandler::Protocol, protocol);
+
+    Recording recording(protocol);
+    for (int i = 0; i < 10; ++i)
+        recording.move(2, 0);
+    recording.setLeftButton(true);
+    for (int i = 0; i < 5; ++i)
+        recording.move(1, 0);
+    recording.setLeftButton(false);
+
+    QBsdFbPointerHandler handler(protocol);
+    centerPointer();
+    handler.feed(reinterpret_cast<const uchar *>(recording.data().constData()), recording.data().size());
+
+    QCOMPARE(handler.samples(), 15);
+    QCOMPARE(handler.moves(), 2);
+
+    const QVector<MouseEvent> events = takeMouseEvents();
+    QCOMPARE(events.size(), 4);
+    QCOMPARE(events.at(0).pos, m_center + QPoint(20, 0));
+    QCOMPARE(events.at(0).buttons, Qt::MouseButtons(Qt::NoButton));
+    QCOMPARE(events.at(1).pos, m_center + QPoint(20, 0));
+    QCOMPARE(events.at(1).buttons, Qt::MouseButtons(Qt::LeftButton));
+    QCOMPARE(events.at(2).pos, m_center + QPoint(25, 0));
+    QCOMPARE(events.at(2).buttons, Qt::MouseButtons(Qt::LeftButton));
+    QCOMPARE(events.at(3).pos, m_center + QPoint(25, 0));
+    QCOMPARE(events.at(3).buttons, Qt::MouseButtons(Qt::NoButton));
+}
+
+// Two mice move the same pointer instead of each keeping a position
+void tst_QBsdFbInput::sharedPosition()
+{
+    QFETCH(QBsdFbPointerHandler::Protocol, protocol);
+
+    Recording first(QBsdFbPointerHandler::SysMouse);
+    first.move(10, 0);
+    Recording second(protocol);
+    second.move(5, 0);
+
+    QBsdFbPointerHandler firstHandler(QBsdFbPointerHandler::SysMouse);
+    QBsdFbPointerHandler secondHandler(protocol);
+    centerPointer();
+
+    firstHandler.feed(reinterpret_cast<const uchar *>(first.data().constData()), first.data().size());
+    secondHandler.feed(reinterpret_cast<const uchar *>(second.data().constData()), second.data().size());
+
+    const QVector<MouseEvent> events = takeMouseEvents();
+    QCOMPARE(events.size(), 2);
+    QCOMPARE(events.at(0).pos, m_center + QPoint(10, 0));
+    QCOMPARE(events.at(1).pos, m_center + QPoint(15, 0));
+}
+
+// Played back at ReplayRecords records per millisecond, the samples have to
+// be merged into fewer moves however slowly the timer fires
+void tst_QBsdFbInput::replay()
+{
+    QFETCH(QBsdFbPointerHandler::Protocol, protocol);
+
+    Recording recording(protocol);
+    recording.setLeftButton(true);
+    for (int i = 0; i < 200; ++i)
+        recording.move(1, 0);
+    recording.setLeftButton(false);
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QCOMPARE(file.write(recording.data()), qint64(recording.data().size()));
+    file.close();
+
+    QBsdFbInputReplay replay(protocol, file.fileName());
+    QVERIFY(replay.isValid());
+    centerPointer();
+    QTRY_VERIFY(replay.isFinished());
+
+    QCOMPARE(replay.handler().samples(), 200);
+    QVERIFY(replay.handler().moves() >= 1);
+    QVERIFY(replay.handler().moves() < replay.handler().samples());
+}
+
+int main(int argc, char **argv)
+{
+    // The handler only needs a primary screen
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "minimal");
+
+    QGuiApplication app(argc, argv);
+    tst_QBsdFbInput test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_qbsdfbinput.moc"
@@ -0,0 +1,5 @@
+TARGET = tst_qbsdfbscreen
+
+QT = core gui testlib
+
+SOURCES = tst_qbsdfbscreen.cpp
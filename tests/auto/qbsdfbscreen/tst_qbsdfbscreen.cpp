@@ -0,0 +1,156 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+#include <QtGui/QBackingStore>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QPainter>
+#include <QtGui/QScreen>
+#include <QtGui/QWindow>
+#include <QtTest/QtTest>
+
+// Brings up the bsdfb plugin, which has to be found on the plugin path, on
+// file backed virtual framebuffers, one screen per pixel layout without a
+// QImage format of its own. Such screens compose in RGB32 and only the
+// blitter knows the real layout.
+static const struct {
+    const char *layout;
+    int depth;
+    // A red pixel as stored in the framebuffer
+    const char *red;
+    int bytesPerPixel;
+} layouts[] = {
+    { "bgr565", 16, "\x1f\x00", 2 },
+    { "xbgr1555", 16, "\x1f\x00", 2 },
+    { "rgb888", 24, "\x00\x00\xff", 3 }
+};
+
+enum {
+    Width = 64,
+    Height = 48
+};
+
+static QTemporaryDir *framebufferDir = nullptr;
+
+static QString framebufferFile(const char *layout)
+{
+    return framebufferDir->path() + QLatin1Char('/') + QLatin1String(layout);
+}
+
+static QByteArray firstPixel(const QString &fileName, int bytesPerPixel)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.read(bytesPerPixel);
+}
+
+class tst_QBsdFbScreen : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void convertedLayout_data();
+    void convertedLayout();
+};
+
+// Screens that fail to initialize are dropped, so every layout has to show
+// up as a screen of its own
+void tst_QBsdFbScreen::initTestCase()
+{
+    QCOMPARE(QGuiApplication::platformName(), QStringLiteral("bsdfb"));
+    QCOMPARE(QGuiApplication::screens().size(), int(sizeof(layouts) / sizeof(*layouts)));
+}
+
+void tst_QBsdFbScreen::convertedLayout_data()
+{
+    QTest::addColumn<int>("screen");
+
+    for (int i = 0; i < int(sizeof(layouts) / sizeof(*layouts)); ++i)
+        QTest::newRow(layouts[i].layout) << i;
+}
+
+void tst_QBsdFbScreen::convertedLayout()
+{
+    QFETCH(int, screen);
+
+    QScreen *target = QGuiApplication::screens().at(screen);
+    QCOMPARE(target->geometry().size(), QSize(Width, Height));
+
+    QWindow window;
+    window.setScreen(target);
+    window.setGeometry(target->geometry());
+    QBackingStore store(&window);
+    store.resize(window.size());
+    window.show();
+
+    const QRect bounds(QPoint(0, 0), window.size());
+    store.beginPaint(bounds);
+    {
+        QPainter painter(store.paintDevice());
+        painter.fillRect(bounds, Qt::red);
+    }
+    store.endPaint();
+    store.flush(bounds);
+
+    const QString fileName = framebufferFile(layouts[screen].layout);
+    const QByteArray red(layouts[screen].red, layouts[screen].bytesPerPixel);
+    QTRY_COMPARE(firstPixel(fileName, red.size()).toHex(), red.toHex());
+}
+
+int main(int argc, char **argv)
+{
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        qWarning("Cannot create a directory for the virtual framebuffers");
+        return 1;
+    }
+    framebufferDir = &dir;
+
+    QByteArray platform("bsdfb:present=sync");
+    for (const auto &l : layouts) {
+        platform += ":fb=virtual," + QByteArray::number(int(Width)) + 'x' + QByteArray::number(int(Height))
+                + 'x' + QByteArray::number(l.depth) + ",layout=" + l.layout
+                + ',' + QFile::encodeName(framebufferFile(l.layout));
+    }
+    qputenv("QT_QPA_PLATFORM", platform);
+
+    QGuiApplication app(argc, argv);
+    tst_QBsdFbScreen test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_qbsdfbscreen.moc"
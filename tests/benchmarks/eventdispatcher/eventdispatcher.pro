@@ -0,0 +1,13 @@
+TARGET = tst_bench_bsdfbeventdispatcher
+
+QT = core-private gui-private testlib
+
+CONFIG += release
+
+INCLUDEPATH += ../../..
+
+SOURCES = \
+    tst_bench_bsdfbeventdispatcher.cpp \
+    ../../../qbsdfbeventdispatcher.cpp
+
+HEADERS = ../../../qbsdfbeventdispatcher.h
@@ -0,0 +1,214 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qbsdfbeventdispatcher.h"
+
+#include <QtTest/QtTest>
+#include <QtCore/QSemaphore>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QThread>
+#include <QtCore/private/qeventdispatcher_unix_p.h>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+// Compares the wakeup latency and CPU cost of the generic event dispatcher
+// and the kernel queue one for a growing number of socket notifiers. Each
+// iteration writes a byte to one of the pipes and waits until the thread
+// running the dispatcher has read it. Median and 99th percentile latency
+// and the dispatcher thread's CPU time per wakeup are printed as well.
+
+static qint64 threadCpuTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return qint64(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Runs an event loop on the dispatcher under test with a read notifier on
+// each pipe; every activation drains one byte and reports back
+class NotifierThread : public QThread
+{
+public:
+    NotifierThread(const QVector<int> &fds, const QElapsedTimer &clock)
+        : m_fds(fds), m_clock(clock)
+    {
+    }
+
+    QAtomicInteger<qint64> sent;
+    QSemaphore ready;
+    QSemaphore done;
+    QVector<qint64> latencies;
+    qint64 cpuTime = 0;
+
+protected:
+    void run() override
+    {
+        QVector<QSocketNotifier *> notifiers;
+        for (int fd : qAsConst(m_fds)) {
+            QSocketNotifier *notifier = new QSocketNotifier(fd, QSocketNotifier::Read);
+            QObject::connect(notifier, &QSocketNotifier::activated, [this](int socket) {
+                char c;
+                if (::read(socket, &c, 1) == 1) {
+                    latencies.append(m_clock.nsecsElapsed() - sent.load());
+                    done.release();
+                }
+            });
+            notifiers.append(notifier);
+        }
+        latencies.reserve(1024);
+        ready.release();
+
+        const qint64 start = threadCpuTime();
+        exec();
+        cpuTime = threadCpuTime() - start;
+
+        qDeleteAll(notifiers);
+    }
+
+private:
+    QVector<int> m_fds;
+    const QElapsedTimer &m_clock;
+};
+
+class tst_BsdFbEventDispatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void wakeup_data();
+    void wakeup();
+
+private:
+    quint32 random();
+
+    quint32 m_seed = 1;
+};
+
+// Fixed-seed LCG so that every run spreads the wakeups the same way
+quint32 tst_BsdFbEventDispatcher::random()
+{
+    m_seed = m_seed * 1103515245u + 12345u;
+    return m_seed >> 8;
+}
+
+void tst_BsdFbEventDispatcher::wakeup_data()
+{
+    QTest::addColumn<bool>("generic");
+    QTest::addColumn<int>("notifiers");
+
+    static const int counts[] = { 1, 16, 64, 256, 1024 };
+    for (int count : counts) {
+        QTest::newRow(qPrintable(QStringLiteral("generic-%1").arg(count))) << true << count;
+#if defined(QBSDFB_EVENTDISPATCHER_KQUEUE) || defined(QBSDFB_EVENTDISPATCHER_EPOLL)
+        QTest::newRow(qPrintable(QStringLiteral("%1-%2").arg(QLatin1String(QBsdFbEventDispatcher::backendName()))
+                                 .arg(count)))
+            << false << count;
+#endif
+    }
+}
+
+void tst_BsdFbEventDispatcher::wakeup()
+{
+    QFETCH(bool, generic);
+    QFETCH(int, notifiers);
+
+    // Two fds per pipe and some headroom for the rest of the process
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur != RLIM_INFINITY && rlim_t(notifiers) * 2 + 64 > limit.rlim_cur)
+        QSKIP("Too many notifiers for the file descriptor limit");
+
+    QVector<int> readFds;
+    QVector<int> writeFds;
+    for (int i = 0; i < notifiers; ++i) {
+        int fds[2];
+        QVERIFY2(::pipe(fds) == 0, strerror(errno));
+        readFds.append(fds[0]);
+        writeFds.append(fds[1]);
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+
+    // The thread takes ownership of the dispatcher
+    NotifierThread thread(readFds, clock);
+#if defined(QBSDFB_EVENTDISPATCHER_KQUEUE) || defined(QBSDFB_EVENTDISPATCHER_EPOLL)
+    if (!generic)
+        thread.setEventDispatcher(new QBsdFbEventDispatcher);
+    else
+#else
+    Q_UNUSED(generic);
+#endif
+        thread.setEventDispatcher(new QEventDispatcherUNIX);
+    thread.start();
+    thread.ready.acquire();
+
+    m_seed = 1;
+    bool lost = false;
+    QBENCHMARK {
+        // Spread the wakeups over all pipes
+        const int fd = writeFds.at(random() % writeFds.size());
+        const char c = 0;
+        thread.sent.store(clock.nsecsElapsed());
+        if (::write(fd, &c, 1) != 1 || !thread.done.tryAcquire(1, 5000))
+            lost = true;
+    }
+
+    thread.quit();
+    thread.wait();
+
+    for (int fd : qAsConst(readFds))
+        ::close(fd);
+    for (int fd : qAsConst(writeFds))
+        ::close(fd);
+
+    QVERIFY2(!lost, "A wakeup was lost");
+    QVERIFY(!thread.latencies.isEmpty());
+
+    QVector<qint64> &latencies = thread.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    qInfo("%8.1f us median %8.1f us p99 %8.1f us CPU/wakeup",
+          latencies.at(latencies.size() / 2) / 1e3,
+          latencies.at(latencies.size() * 99 / 100) / 1e3,
+          thread.cpuTime / 1e3 / latencies.size());
+}
+
+QTEST_GUILESS_MAIN(tst_BsdFbEventDispatcher)
+
+#include "tst_bench_bsdfbeventdispatcher.moc"
@@ -0,0 +1,7 @@
+TARGET = tst_bench_bsdfbpresentation
+
+QT = core gui testlib
+
+CONFIG += release
+
+SOURCES = tst_bench_bsdfbpresentation.cpp
@@ -0,0 +1,272 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtCore/QElapsedTimer>
+#include <QtGui/QBackingStore>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QPainter>
+#include <QtGui/QScreen>
+#include <QtGui/QWindow>
+
+// Composes and presents frames through the bsdfb plugin, which has to be
+// found on the plugin path, into in-memory framebuffers. Every fb= argument
+// of the platform is a screen of its own, so by default one run covers all
+// three depths. Other platform arguments apply to every screen, which makes
+// options comparable, e.g.
+//
+//   tst_bench_bsdfbpresentation -platform bsdfb:fb=virtual,1280x720x32:present=async
+//
+// With present=async only the GUI thread's share of a frame is measured.
+// Several screens would be presented asynchronously by default, so the
+// default run asks for synchronous presentation explicitly.
+static const char defaultPlatform[] =
+    "bsdfb:present=sync:fb=virtual,1280x720x16:fb=virtual,1280x720x24:fb=virtual,1280x720x32";
+
+enum Pattern {
+    FullScreen,
+    SmallRects,
+    ScrollingBand,
+    StackedWindows
+};
+Q_DECLARE_METATYPE(Pattern)
+
+enum {
+    SmallRectCount = 64,
+    SmallRectSize = 32,
+    BandHeight = 64,
+    BandStep = 16,
+    ScrollStep = 8,
+    ThroughputFrames = 200
+};
+
+class tst_BsdFbPresentation : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void present_data();
+    void present();
+    void throughput_data() { present_data(); }
+    void throughput();
+
+private:
+    quint32 random();
+    QRegion paintFrame(QBackingStore *store, Pattern pattern, int frame);
+    QRegion presentFrame(QBackingStore *store, Pattern pattern, int frame);
+
+    quint32 m_seed = 1;
+};
+
+// Fixed-seed LCG so that every run produces the same damage
+quint32 tst_BsdFbPresentation::random()
+{
+    m_seed = m_seed * 1103515245u + 12345u;
+    return m_seed >> 8;
+}
+
+void tst_BsdFbPresentation::present_data()
+{
+    QTest::addColumn<int>("screen");
+    QTest::addColumn<Pattern>("pattern");
+
+    static const struct {
+        const char *name;
+        Pattern pattern;
+    } patterns[] = {
+        { "fullscreen", FullScreen },
+        { "smallrects", SmallRects },
+        { "scrolling", ScrollingBand },
+        { "stacked", StackedWindows }
+    };
+
+    const QList<QScreen *> screens = QGuiApplication::screens();
+    for (int i = 0; i < screens.size(); ++i) {
+        for (const auto &p : patterns) {
+            QTest::newRow(qPrintable(QStringLiteral("%1-%2bpp-%3").arg(i).arg(screens.at(i)->depth())
+                                     .arg(QLatin1String(p.name))))
+                << i << p.pattern;
+        }
+    }
+}
+
+QRegion tst_BsdFbPresentation::paintFrame(QBackingStore *store, Pattern pattern, int frame)
+{
+    const QRect bounds(QPoint(0, 0), store->size());
+    const QColor color = QColor::fromHsv((frame * 7) % 360, 255, 255);
+    QRegion damage;
+
+    switch (pattern) {
+    case FullScreen:
+    case StackedWindows:
+        damage = bounds;
+        break;
+    case SmallRects:
+        for (int i = 0; i < SmallRectCount; ++i) {
+            damage += QRect(random() % (bounds.width() - SmallRectSize),
+                            random() % (bounds.height() - SmallRectSize),
+                            SmallRectSize, SmallRectSize);
+        }
+        break;
+    case ScrollingBand:
+        // A band repainted a few lines further down each frame, the way a
+        // scrolling list view repaints
+        damage = QRect(0, (frame * BandStep) % (bounds.height() - BandHeight), bounds.width(), BandHeight);
+        break;
+    }
+
+    store->beginPaint(damage);
+    {
+        QPainter painter(store->paintDevice());
+        const auto rects = damage.rects();
+        for (const QRect &rect : rects) {
+            const QColor fill = pattern == SmallRects ? QColor::fromRgb(random() | 0xff000000) : color;
+            painter.fillRect(rect, fill);
+            if (pattern == ScrollingBand)
+                painter.fillRect(rect.adjusted(0, BandHeight - ScrollStep, 0, 0), color.darker());
+        }
+    }
+    store->endPaint();
+    return damage;
+}
+
+// The windows a pattern draws into, shown on the target screen
+class Scene
+{
+public:
+    Scene(QScreen *target, Pattern pattern);
+
+    QBackingStore *background() { return &m_backgroundStore; }
+    QBackingStore *store() { return m_topStore ? m_topStore.data() : &m_backgroundStore; }
+
+private:
+    QWindow m_background;
+    QBackingStore m_backgroundStore;
+    // Only the top window changes; the one below shows around it
+    QWindow m_top;
+    QScopedPointer<QBackingStore> m_topStore;
+};
+
+Scene::Scene(QScreen *target, Pattern pattern)
+    : m_backgroundStore(&m_background)
+{
+    const QRect geometry = target->geometry();
+
+    m_background.setScreen(target);
+    m_background.setGeometry(geometry);
+    m_backgroundStore.resize(geometry.size());
+    m_background.show();
+
+    if (pattern == StackedWindows) {
+        m_top.setScreen(target);
+        m_top.setGeometry(QRect(geometry.center() - QPoint(geometry.width() / 4, geometry.height() / 4),
+                                geometry.size() / 2));
+        m_topStore.reset(new QBackingStore(&m_top));
+        m_topStore->resize(m_top.size());
+        m_top.show();
+    }
+}
+
+void tst_BsdFbPresentation::present()
+{
+    QFETCH(int, screen);
+    QFETCH(Pattern, pattern);
+
+    QScreen *target = QGuiApplication::screens().at(screen);
+    Scene scene(target, pattern);
+    m_seed = 1;
+    presentFrame(scene.background(), FullScreen, 0);
+    QCoreApplication::processEvents();
+
+    QBackingStore *store = scene.store();
+    int frame = 0;
+    QBENCHMARK {
+        presentFrame(store, pattern, ++frame);
+    }
+}
+
+// The same frames, reported as framebuffer bytes written per second: the
+// damaged area times the framebuffer's bytes per pixel
+void tst_BsdFbPresentation::throughput()
+{
+    QFETCH(int, screen);
+    QFETCH(Pattern, pattern);
+
+    QScreen *target = QGuiApplication::screens().at(screen);
+    Scene scene(target, pattern);
+    m_seed = 1;
+    presentFrame(scene.background(), FullScreen, 0);
+    QCoreApplication::processEvents();
+
+    const int bytesPerPixel = (target->depth() + 7) / 8;
+    QBackingStore *store = scene.store();
+    qint64 bytes = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int frame = 1; frame <= ThroughputFrames; ++frame) {
+        const QRegion damage = presentFrame(store, pattern, frame);
+        const auto rects = damage.rects();
+        for (const QRect &rect : rects)
+            bytes += qint64(rect.width()) * rect.height() * bytesPerPixel;
+    }
+    const qint64 elapsed = qMax(timer.nsecsElapsed(), qint64(1));
+
+    QTest::setBenchmarkResult(bytes * 1e9 / elapsed, QTest::BytesPerSecond);
+}
+
+QRegion tst_BsdFbPresentation::presentFrame(QBackingStore *store, Pattern pattern, int frame)
+{
+    const QRegion damage = paintFrame(store, pattern, frame);
+    store->flush(damage);
+    // Delivers the screen's update request, which composes and presents
+    QCoreApplication::sendPostedEvents();
+    return damage;
+}
+
+int main(int argc, char **argv)
+{
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", defaultPlatform);
+
+    QGuiApplication app(argc, argv);
+    if (QGuiApplication::platformName() != QLatin1String("bsdfb")) {
+        qWarning("The bsdfb platform plugin is needed, got %s", qPrintable(QGuiApplication::platformName()));
+        return 1;
+    }
+
+    tst_BsdFbPresentation test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_bench_bsdfbpresentation.moc"
@@ -0,0 +1,325 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Copyright (C) 2015-2016 Oleksandr Tymoshenko <gonzo@bluezbox.com>
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the plugins of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+// Reference consumer for the damage stream published with the bsdfb
+// mirror=<file> platform argument. It reconstructs the screen from the
+// stream and writes it as a PPM image after every frame:
+//
+//   bsdfbmirror [-n frames] <mirror file> <output.ppm>
+//
+// If the output name contains %d, every frame goes to its own file,
+// numbered by its sequence number.
+
+#include "../../qbsdfbmirrorprotocol.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+static void usage()
+{
+    fprintf(stderr, "usage: bsdfbmirror [-n frames] <mirror file> <output.ppm>\n");
+    exit(1);
+}
+
+static uint32_t toRgb(const uint8_t *pixel, uint32_t format)
+{
+    switch (format) {
+    case MirrorRGB16: {
+        uint16_t p;
+        memcpy(&p, pixel, 2);
+        const uint32_t r = (p >> 11) & 0x1f, g = (p >> 5) & 0x3f, b = p & 0x1f;
+        return ((r << 3 | r >> 2) << 16) | ((g << 2 | g >> 4) << 8) | (b << 3 | b >> 2);
+    }
+    case MirrorRGB888:
+        return uint32_t(pixel[0]) << 16 | uint32_t(pixel[1]) << 8 | pixel[2];
+    default: {
+        uint32_t p;
+        memcpy(&p, pixel, 4);
+        return p & 0xffffff;
+    }
+    }
+}
+
+class Mirror
+{
+public:
+    bool open(const char *fileName);
+    bool next(std::vector<uint8_t> *record);
+    bool apply(const std::vector<uint8_t> &record);
+    bool save(const std::string &fileName) const;
+
+private:
+    bool resync();
+
+    const QBsdFbMirrorHeader *m_header = nullptr;
+    const uint8_t *m_ring = nullptr;
+    uint64_t m_position = 0;
+    bool m_waitForKeyFrame = true;
+    std::vector<uint32_t> m_screen;
+};
+
+bool Mirror::open(const char *fileName)
+{
+    const int fd = ::open(fileName, O_RDWR);
+    if (fd < 0) {
+        perror(fileName);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(QBsdFbMirrorHeader)) {
+        fprintf(stderr, "%s: not a mirror file\n", fileName);
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+
+    m_header = static_cast<const QBsdFbMirrorHeader *>(map);
+    while (__atomic_load_n(&m_header->magic, __ATOMIC_ACQUIRE) != QBsdFbMirrorMagic)
+        usleep(10000);
+
+    if (m_header->version != QBsdFbMirrorVersion
+            || m_header->dataOffset + m_header->dataSize > uint64_t(st.st_size)) {
+        fprintf(stderr, "%s: unsupported mirror file\n", fileName);
+        return false;
+    }
+
+    m_ring = static_cast<const uint8_t *>(map) + m_header->dataOffset;
+    m_screen.assign(size_t(m_header->width) * m_header->height, 0);
+    return resync();
+}
+
+// Skips everything published so far and asks for a full frame
+bool Mirror::resync()
+{
+    m_position = __atomic_load_n(&m_header->writePosition, __ATOMIC_ACQUIRE);
+    m_waitForKeyFrame = true;
+    __atomic_store_n(const_cast<uint32_t *>(&m_header->keyFrameRequest), 1u, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Waits for the next frame record and copies it
+bool Mirror::next(std::vector<uint8_t> *record)
+{
+    const uint64_t dataSize = m_header->dataSize;
+
+    for (;;) {
+        const uint64_t written = __atomic_load_n(&m_header->writePosition, __ATOMIC_ACQUIRE);
+        if (written == m_position) {
+            usleep(5000);
+            continue;
+        }
+        if (written - m_position > dataSize) {
+            fprintf(stderr, "bsdfbmirror: overrun, resynchronizing\n");
+            resync();
+            continue;
+        }
+
+        const uint64_t offset = m_position % dataSize;
+        uint32_t head[2];
+        memcpy(head, m_ring + offset, sizeof(head));
+        if (head[1] < sizeof(head) || offset + head[1] > dataSize || (head[1] & 7)) {
+            resync();
+            continue;
+        }
+
+        if (head[0] == MirrorFrameRecord)
+            record->assign(m_ring + offset, m_ring + offset + head[1]);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        const uint64_t reserved = __atomic_load_n(&m_header->reservePosition, __ATOMIC_RELAXED);
+        if (reserved > m_position + dataSize) {
+            fprintf(stderr, "bsdfbmirror: record overwritten, resynchronizing\n");
+            resync();
+            continue;
+        }
+
+        m_position += head[1];
+        if (head[0] != MirrorFrameRecord || record->size() < sizeof(QBsdFbMirrorRecord))
+            continue;
+
+        QBsdFbMirrorRecord frame;
+        memcpy(&frame, record->data(), sizeof(frame));
+        if (m_waitForKeyFrame && !(frame.flags & MirrorKeyFrame))
+            continue;
+
+        m_waitForKeyFrame = false;
+        return true;
+    }
+}
+
+bool Mirror::apply(const std::vector<uint8_t> &record)
+{
+    const uint32_t bpp = m_header->bytesPerPixel;
+    const uint32_t format = m_header->format;
+    const uint8_t *end = record.data() + record.size();
+
+    QBsdFbMirrorRecord frame;
+    memcpy(&frame, record.data(), sizeof(frame));
+    const uint8_t *p = record.data() + sizeof(frame);
+
+    for (uint32_t i = 0; i < frame.rectCount; ++i) {
+        QBsdFbMirrorRect rect;
+        if (p + sizeof(rect) > end)
+            return false;
+        memcpy(&rect, p, sizeof(rect));
+        p += sizeof(rect);
+
+        const uint8_t *data = p;
+        const uint8_t *dataEnd = p + rect.size;
+        if (dataEnd > end || rect.x + rect.width > m_header->width || rect.y + rect.height > m_header->height)
+            return false;
+
+        for (uint32_t y = 0; y < rect.height; ++y) {
+            uint32_t *line = &m_screen[size_t(rect.y + y) * m_header->width + rect.x];
+            if (rect.encoding == MirrorRaw) {
+                if (data + rect.width * bpp > dataEnd)
+                    return false;
+                for (uint32_t x = 0; x < rect.width; ++x, data += bpp)
+                    line[x] = toRgb(data, format);
+                continue;
+            }
+
+            uint32_t x = 0;
+            while (x < rect.width) {
+                if (data >= dataEnd)
+                    return false;
+                const uint8_t control = *data++;
+                if (control < 128) {
+                    const uint32_t count = control + 1u;
+                    if (x + count > rect.width || data + count * bpp > dataEnd)
+                        return false;
+                    for (uint32_t n = 0; n < count; ++n, data += bpp)
+                        line[x++] = toRgb(data, format);
+                } else {
+                    const uint32_t count = control - 126u;
+                    if (x + count > rect.width || data + bpp > dataEnd)
+                        return false;
+                    const uint32_t rgb = toRgb(data, format);
+                    data += bpp;
+                    for (uint32_t n = 0; n < count; ++n)
+                        line[x++] = rgb;
+                }
+            }
+        }
+
+        p += qbsdfbMirrorAlign(rect.size);
+    }
+
+    return true;
+}
+
+// Written to a temporary file first so that viewers never see half a frame
+bool Mirror::save(const std::string &fileName) const
+{
+    const std::string temp = fileName + ".tmp";
+    FILE *f = fopen(temp.c_str(), "wb");
+    if (!f) {
+        perror(temp.c_str());
+        return false;
+    }
+
+    fprintf(f, "P6\n%u %u\n255\n", m_header->width, m_header->height);
+    std::vector<uint8_t> row(size_t(m_header->width) * 3);
+    for (uint32_t y = 0; y < m_header->height; ++y) {
+        const uint32_t *line = &m_screen[size_t(y) * m_header->width];
+        for (uint32_t x = 0; x < m_header->width; ++x) {
+            row[x * 3] = uint8_t(line[x] >> 16);
+            row[x * 3 + 1] = uint8_t(line[x] >> 8);
+            row[x * 3 + 2] = uint8_t(line[x]);
+        }
+        fwrite(row.data(), 1, row.size(), f);
+    }
+
+    if (fclose(f) != 0 || rename(temp.c_str(), fileName.c_str()) != 0) {
+        perror(fileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    long frames = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt != 'n')
+            usage();
+        frames = strtol(optarg, nullptr, 10);
+    }
+    if (argc - optind != 2)
+        usage();
+
+    const std::string output = argv[optind + 1];
+    const bool numbered = output.find("%d") != std::string::npos;
+
+    Mirror mirror;
+    if (!mirror.open(argv[optind]))
+        return 1;
+
+    std::vector<uint8_t> record;
+    for (long count = 0; frames < 0 || count < frames; ++count) {
+        mirror.next(&record);
+
+        QBsdFbMirrorRecord frame;
+        memcpy(&frame, record.data(), sizeof(frame));
+        if (!mirror.apply(record)) {
+            fprintf(stderr, "bsdfbmirror: malformed frame %llu\n", (unsigned long long)frame.sequence);
+            return 1;
+        }
+
+        std::string fileName = output;
+        if (numbered)
+            fileName.replace(fileName.find("%d"), 2, std::to_string(frame.sequence));
+        if (!mirror.save(fileName))
+            return 1;
+    }
+
+    return 0;
+}
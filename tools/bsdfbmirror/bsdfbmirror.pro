@@ -0,0 +1,8 @@
+TEMPLATE = app
+TARGET = bsdfbmirror
+
+CONFIG += console c++11
+CONFIG -= qt app_bundle
+
+SOURCES = bsdfbmirror.cpp
+HEADERS = ../../qbsdfbmirrorprotocol.h